@@ -21,6 +21,7 @@
  *     Lucas Braun <braunl@inf.ethz.ch>
  */
 #pragma once
+#include "bdtree/double_word_atomic.h"
 #include "bdtree/primitive_types.h"
 #include "bdtree/node_pointer.h"
 
@@ -32,40 +33,6 @@
 
 namespace bdtree {
 
-template<typename T>
-struct double_word_atomic {
-private:
-    __int128 data;
-public:
-    double_word_atomic() {
-        new (&data)T();
-    }
-    static_assert(sizeof(T) <= 16, "Type is too big");
-    static_assert(sizeof(T) > 8, "One should not use double_word_atomic for types smaller than 8");
-
-
-#if defined(__GNUC__)
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wstrict-aliasing"
-#endif
-    T load() {
-        __int128 res = __atomic_load_n(&data, __ATOMIC_SEQ_CST);
-        return reinterpret_cast<T&>(res);
-    }
-    void store(T desired) {
-        __atomic_store_n(&data, reinterpret_cast<__int128&>(desired), __ATOMIC_SEQ_CST);
-    }
-
-    bool cas(T& expected, T desired) {
-        return __atomic_compare_exchange(&data, reinterpret_cast<__int128*>(&expected), reinterpret_cast<__int128*>(&desired), false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
-    }
-
-#if defined(__GNUC__)
-#pragma GCC diagnostic pop
-#endif
-
-};
-
 enum class cache_return {
     Nop,
     Read,
@@ -23,7 +23,13 @@
 #pragma once
 
 #include <bdtree/base_types.h>
+#include <bdtree/pointer_lease.h>
 
+#include <crossbow/allocator.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
 #include <system_error>
 #include <tuple>
 
@@ -36,11 +42,59 @@ inline void throw_error(const std::error_code& ec) {
     }
 }
 
+/**
+ * @brief The table deferred removals go to, cleared when the table is destroyed
+ */
+template <typename Table>
+struct retire_target {
+    std::mutex mutex;
+    Table* table;
+
+    explicit retire_target(Table* table)
+            : table(table) {
+    }
+};
+
+template <typename Table>
+struct retired_object {
+    std::shared_ptr<retire_target<Table>> target;
+    physical_pointer pptr;
+
+    retired_object(std::shared_ptr<retire_target<Table>> target, physical_pointer pptr)
+            : target(std::move(target)), pptr(pptr) {
+    }
+
+    ~retired_object() {
+        std::lock_guard<std::mutex> _(target->mutex);
+        if (target->table != nullptr) {
+            target->table->remove_retired(pptr);
+        }
+    }
+
+    void* operator new(std::size_t size) {
+        return crossbow::allocator::malloc(size);
+    }
+
+    void operator delete(void* ptr) {
+        crossbow::allocator::free_now(ptr);
+    }
+};
+
 } // namespace detail
 
+/**
+ * @brief Base of the pointer tables, HandlerType implements the error_code overloads
+ *
+ * The tree takes new logical pointers through next_ptr. A table that can hand out several pointers in one request
+ * provides Pointer reserve_ptrs(uint64_t count), returning the first of count consecutive pointers that get_next_ptr
+ * will not return. next_ptr then takes PTR_LEASE_SIZE pointers at a time and gives them out from a per-thread lease.
+ * Without reserve_ptrs every call goes to get_next_ptr. The same holds for base_node_table.
+ */
 template <typename HandlerType>
 class base_ptr_table {
 public:
+    logical_pointer next_ptr();
+
     std::tuple<physical_pointer, uint64_t> read(logical_pointer lptr);
 
     uint64_t insert(logical_pointer lptr, physical_pointer pptr);
@@ -48,8 +102,16 @@ public:
     uint64_t update(logical_pointer lptr, physical_pointer pptr, uint64_t version);
 
     void remove(logical_pointer lptr, uint64_t version);
+
+private:
+    detail::pointer_leases leases_;
 };
 
+template <typename HandlerType>
+logical_pointer base_ptr_table<HandlerType>::next_ptr() {
+    return detail::next_ptr<logical_pointer>(*static_cast<HandlerType*>(this), leases_, 0);
+}
+
 template <typename HandlerType>
 std::tuple<physical_pointer, uint64_t> base_ptr_table<HandlerType>::read(logical_pointer lptr) {
     std::error_code ec;
@@ -81,16 +143,67 @@ void base_ptr_table<HandlerType>::remove(logical_pointer lptr, uint64_t version)
     detail::throw_error(ec);
 }
 
+/**
+ * @brief Base of the node tables, HandlerType implements the error_code overloads
+ *
+ * read returns a DataType, the result of a read, which has to provide
+ *  - const char* data() const and size_t length() const giving the serialized node,
+ *  - cheap copies; the tree keeps results around while it resolves a delta chain.
+ * The bytes must not change while the result is alive. A result may in addition provide
+ *  - std::shared_ptr<const void> owner() const, a reference keeping the bytes alive.
+ * Decoded nodes then point into the buffer instead of copying parts of it, see shared_node_data for a result type
+ * that provides it. Backends that read into temporary memory simply leave owner() out.
+ *
+ * Objects other threads may still read, like values of erased entries, are removed through retire: the removal
+ * happens once every thread that was inside a crossbow::allocator scope at the time has left it.
+ */
 template <typename HandlerType, typename DataType>
 class base_node_table {
 public:
+    base_node_table()
+            : retire_target_(std::make_shared<detail::retire_target<base_node_table>>(this)) {
+    }
+
+    base_node_table(const base_node_table&)
+            : base_node_table() {
+    }
+
+    base_node_table& operator= (const base_node_table&) {
+        return *this;
+    }
+
+    ~base_node_table() {
+        std::lock_guard<std::mutex> _(retire_target_->mutex);
+        retire_target_->table = nullptr;
+    }
+
+    physical_pointer next_ptr();
+
     DataType read(physical_pointer pptr);
 
     void insert(physical_pointer pptr, const char* data, size_t length);
 
     void remove(physical_pointer pptr);
+
+    void retire(physical_pointer pptr);
+
+private:
+    friend struct detail::retired_object<base_node_table>;
+
+    void remove_retired(physical_pointer pptr) {
+        std::error_code ec;
+        static_cast<HandlerType*>(this)->remove(pptr, ec);
+    }
+
+    detail::pointer_leases leases_;
+    std::shared_ptr<detail::retire_target<base_node_table>> retire_target_;
 };
 
+template <typename HandlerType, typename DataType>
+physical_pointer base_node_table<HandlerType, DataType>::next_ptr() {
+    return detail::next_ptr<physical_pointer>(*static_cast<HandlerType*>(this), leases_, 0);
+}
+
 template <typename HandlerType, typename DataType>
 DataType base_node_table<HandlerType, DataType>::read(physical_pointer pptr) {
     std::error_code ec;
@@ -113,4 +226,9 @@ void base_node_table<HandlerType, DataType>::remove(physical_pointer pptr) {
     detail::throw_error(ec);
 }
 
+template <typename HandlerType, typename DataType>
+void base_node_table<HandlerType, DataType>::retire(physical_pointer pptr) {
+    crossbow::allocator::destroy(new detail::retired_object<base_node_table>(retire_target_, pptr));
+}
+
 } // namespace bdtree
@@ -23,13 +23,17 @@
 #pragma once
 
 #include <bdtree/forward_declarations.h>
+#include <bdtree/node_data.h>
+#include <bdtree/node_format.h>
+#include <bdtree/pointer_stack.h>
+#include <bdtree/serialize_buffer.h>
 #include <bdtree/primitive_types.h>
 #include <bdtree/stl_specializations.h>
 
 #include <crossbow/Serializer.hpp>
 #include <crossbow/allocator.hpp>
 
-#include <stack>
+#include <memory>
 #include <vector>
 
 #ifndef NDEBUG
@@ -51,7 +55,7 @@ struct operation_context {
     Backend& backend;
     logical_table_cache<Key, Value, Backend>& cache;
     uint64_t tx_id;
-    std::stack<logical_pointer> node_stack;
+    pointer_stack node_stack;
 #ifndef NDEBUG
     std::unordered_set<logical_pointer> locks;
 #endif
@@ -91,6 +95,7 @@ template<typename Key, typename Value>
 struct node {
 public:
     typedef Key key_type;
+    static constexpr uint8_t supported_formats = node_format::plain;
 public:
     virtual ~node() {}
 public: // operations
@@ -140,72 +145,118 @@ struct serializable_node : T<Key, Value> {
     
     using T<Key, Value>::visit;
 
+    static constexpr uint8_t format = node_format_traits<Key, Value>::flags & T<Key, Value>::supported_formats
+            & uint8_t(key_formats<Key>::supported | ~node_format::key_flags);
+
     std::vector<uint8_t> serialize() const override {
+        std::vector<uint8_t> res;
+        serialize_into(res);
+        return res;
+    }
+
+    /**
+     * @brief Replaces the content of buffer with the serialized node, reusing its capacity
+     */
+    void serialize_into(std::vector<uint8_t>& buffer) const {
+        serialize_into(buffer, std::integral_constant<bool, format != node_format::plain>());
+    }
+
+    std::size_t serialized_size() const {
+        return serialized_size(std::integral_constant<bool, format != node_format::plain>());
+    }
+
+    bool accept(operation<Key, Value>& o) override {
+        return o.visit(*this);
+    }
+
+private:
+    void serialize_into(std::vector<uint8_t>& res, std::false_type) const {
         std::size_t size = serialized_size();
-        std::vector<uint8_t> res(size);
+        res.resize(size);
         res[0] = uint8_t(T<Key, Value>::node_type);
         static_assert(sizeof(uint8_t) == sizeof(parent::node_type), "Can not assign node type to uint8_t");
         crossbow::serializer_into_array ser(res.data() + sizeof(parent::node_type));
         ser & *this;
-        return res;
     }
 
-    std::size_t serialized_size() const {
+    void serialize_into(std::vector<uint8_t>& res, std::true_type) const {
+        res.clear();
+        res.reserve(serialized_size());
+        res.push_back(uint8_t(T<Key, Value>::node_type) | format);
+        wire_writer w(res);
+        this->encode(w, format);
+    }
+
+    std::size_t serialized_size(std::false_type) const {
         crossbow::sizer s;
         s & *this;
         return s.size + sizeof(parent::node_type);
     }
 
-    bool accept(operation<Key, Value>& o) override {
-        return o.visit(*this);
+    std::size_t serialized_size(std::true_type) const {
+        wire_sizer s;
+        this->encode(s, format);
+        return s.size + sizeof(parent::node_type);
     }
 };
 
+template<typename NodeType>
+void deserialize_node(NodeType& node, const uint8_t* ptr, uint8_t format, std::shared_ptr<const void> owner = nullptr) {
+    if (format == node_format::plain) {
+        crossbow::deserialize(node, ptr);
+    } else {
+        wire_reader r(ptr, std::move(owner));
+        node.decode(r, format);
+    }
+}
+
 // TODO: Implement
 template<typename Key, typename Value>
-node<Key, Value>* deserialize(const uint8_t* ptr, uint64_t size, physical_pointer pptr) {
-    node_type_t type = node_type_t(*ptr);
+node<Key, Value>* deserialize(const uint8_t* ptr, uint64_t size, physical_pointer pptr,
+        std::shared_ptr<const void> owner = nullptr) {
+    node_type_t type = node_type_t(*ptr & node_format::type_mask);
+    uint8_t format = *ptr & node_format::flags_mask;
     switch (type) {
     case node_type_t::InnerNode:
     {
         inner_node<Key, Value> *res = new inner_node<Key, Value>(pptr);
-        crossbow::deserialize(*res, ptr + 1);
+        deserialize_node(*res, ptr + 1, format);
         return res;
     }
     case node_type_t::LeafNode:
     {
         leaf_node<Key, Value> *res = new leaf_node<Key, Value>(pptr);
-        crossbow::deserialize(*res, ptr + 1);
+        deserialize_node(*res, ptr + 1, format, std::move(owner));
         return res;
     }
     case node_type_t::InsertDelta:
     {
         insert_delta<Key, Value> *res = new insert_delta<Key, Value>();
-        crossbow::deserialize(*res, ptr + 1);
+        deserialize_node(*res, ptr + 1, format);
         return res;
     }
     case node_type_t::DeleteDelta:
     {
         delete_delta<Key, Value> *res = new delete_delta<Key, Value>();
-        crossbow::deserialize(*res, ptr + 1);
+        deserialize_node(*res, ptr + 1, format);
         return res;
     }
     case node_type_t::SplitDelta:
     {
         split_delta<Key, Value> *res = new split_delta<Key, Value>();
-        crossbow::deserialize(*res, ptr + 1);
+        deserialize_node(*res, ptr + 1, format);
         return res;
     }
     case node_type_t::RemoveDelta:
     {
         remove_delta<Key, Value> *res = new remove_delta<Key, Value>();
-        crossbow::deserialize(*res, ptr + 1);
+        deserialize_node(*res, ptr + 1, format);
         return res;
     }
     case node_type_t::MergeDelta:
     {
         merge_delta<Key, Value> *res = new merge_delta<Key, Value>();
-        crossbow::deserialize(*res, ptr + 1);
+        deserialize_node(*res, ptr + 1, format);
         return res;
     }
     default:
@@ -214,4 +265,13 @@ node<Key, Value>* deserialize(const uint8_t* ptr, uint64_t size, physical_pointe
     }
     return nullptr;
 }
+
+/**
+ * @brief Deserializes a node read from a node table, leaves may keep referring to memory the backend shares
+ */
+template<typename Key, typename Value, typename DataType>
+node<Key, Value>* deserialize(const DataType& data, physical_pointer pptr) {
+    return deserialize<Key, Value>(reinterpret_cast<const uint8_t*>(data.data()), data.length(), pptr,
+            node_data_owner(data));
+}
 }
@@ -26,19 +26,23 @@
 #include <bdtree/primitive_types.h>
 #include <bdtree/forward_declarations.h>
 #include <bdtree/base_types.h>
+#include <bdtree/key_encoding.h>
 #include <bdtree/stl_specializations.h>
 #include <bdtree/node_pointer.h>
 #include <bdtree/logical_table_cache.h>
 #include <bdtree/deltas.h>
 #include <bdtree/nodes.h>
 #include <bdtree/resolve_operation.h>
+#include <bdtree/separated_value.h>
 #include <bdtree/iterator.h>
 #include <bdtree/search_operation.h>
 #include <bdtree/leaf_operations.h>
 #include <bdtree/error_code.h>
+#include <bdtree/tx_id_source.h>
 
 #include <array>
 #include <limits>
+#include <memory>
 #include <mutex>
 #include <vector>
 
@@ -52,30 +56,87 @@ namespace bdtree {
     template<typename Key, typename Value, typename Backend>
     class map
     {
-        Backend& backend_;
-        logical_table_cache<Key, Value, Backend>& cache_;
+        Backend* backend_;
+        logical_table_cache<Key, Value, Backend>* cache_;
         uint64_t tx_id_;
+        mutable std::unique_ptr<finger<Key, Value, Backend>> finger_;
     public: // types
         typedef Key key_type;
         typedef Value value_type;
         typedef bdtree::erase_result erase_result;
         typedef bdtree_iterator<Key, Value, Backend> iterator;
     public: // construction/destruction
+        /**
+         * @brief Creates a handle on the tree of backend with a new id from the tx id source of the backend
+         */
+        map(Backend& backend, logical_table_cache<Key, Value, Backend>& cache)
+            : map(backend, cache, next_tx_id(backend))
+        {}
+
+        /**
+         * @brief Creates a handle on the tree of backend
+         *
+         * tx_id has to come from the tx id source of the backend, i.e. next_tx_id(backend). get_next_tx_id() is
+         * equivalent only for backends without their own source.
+         */
         map(Backend& backend, logical_table_cache<Key, Value, Backend>& cache, uint64_t tx_id, bool doInit = false)
-            : backend_(backend), cache_(cache), tx_id_(tx_id)
+            : backend_(&backend), cache_(&cache), tx_id_(tx_id)
         {
             if (doInit) {
-                init(backend_, cache_);
+                init(*backend_, *cache_);
             }
         }
 
+        /**
+         * @brief Copies the handle, the copy shares the tx id and starts with an empty finger if the original has one
+         */
+        map(const map& other)
+            : backend_(other.backend_), cache_(other.cache_), tx_id_(other.tx_id_)
+        {
+            set_finger(bool(other.finger_));
+        }
+
+        map& operator=(const map& other) {
+            backend_ = other.backend_;
+            cache_ = other.cache_;
+            tx_id_ = other.tx_id_;
+            set_finger(bool(other.finger_));
+            return *this;
+        }
+
     public: // operations
+        /**
+         * @brief Lets consecutive operations of this handle start at the leaf the previous operation ended in
+         *
+         * Pays off for sequential and clustered access like appends. A handle using a finger must only be used by one
+         * thread at a time.
+         */
+        void set_finger(bool enabled) {
+            finger_.reset(enabled ? new finger<Key, Value, Backend>() : nullptr);
+        }
+
         iterator find(const key_type& key) const {
-            return lower_bound(key, backend_, cache_, tx_id_);
+            return lower_bound(key, *backend_, *cache_, tx_id_, finger_.get());
+        }
+
+        /**
+         * @brief Checks whether key is in the tree, negative lookups are answered from the leaf filters if possible
+         */
+        bool contains(const key_type& key) const {
+            return contains_key(key, *backend_, *cache_, tx_id_);
+        }
+
+        /**
+         * @brief Builds the learned index find and contains use to jump to the leaf of a key
+         *
+         * Meant for read-mostly trees: the index is dropped once it mispredicts too often and has to be rebuilt.
+         */
+        bool build_learned_index() {
+            return bdtree::build_learned_index(*backend_, *cache_, tx_id_);
         }
 
         iterator find_last_smaller_equal(const key_type& key) const {
-            operation_context<Key, Value, Backend> context{backend_, cache_, tx_id_};
+            operation_context<Key, Value, Backend> context{*backend_, *cache_, tx_id_};
 
             logical_pointer lptr{1};
             context.node_stack.push(lptr);
@@ -84,12 +145,12 @@ namespace bdtree {
             assert(res != nullptr);
 
             key_compare<Key, Value> cmp;
-            auto iter = std::upper_bound(res->as_leaf()->array_.begin(), res->as_leaf()->array_.end(), key, cmp);
+            auto iter = key_upper_bound(res->as_leaf()->array_.begin(), res->as_leaf()->array_.end(), key, cmp);
             while (iter == res->as_leaf()->array_.end()) {
                 if (!res->as_leaf()->high_key_)
                     break;
                 res = get_next(context, res);
-                iter = std::upper_bound(res->as_leaf()->array_.begin(), res->as_leaf()->array_.end(), key, cmp);
+                iter = key_upper_bound(res->as_leaf()->array_.begin(), res->as_leaf()->array_.end(), key, cmp);
             }
 
             bdtree_iterator<Key, Value, Backend> i(std::move(context), res, std::move(iter));
@@ -102,9 +163,15 @@ namespace bdtree {
         }
 
         bool insert(const Key& key, const Value& value) {
+            auto& node_table = backend_->get_node_table();
+            auto&& stored = value_storage<Value>::store(value, node_table);
             key_compare<Key, Value> comp;
-            insert_operation<Key, Value> op(key, value, comp);
-            return exec_leaf_operation(key, backend_, cache_, tx_id_, op);
+            insert_operation<Key, Value> op(key, stored, comp);
+            if (exec_leaf_operation(key, *backend_, *cache_, tx_id_, op, finger_.get())) {
+                return true;
+            }
+            value_storage<Value>::discard(stored, value, node_table);
+            return false;
         }
 
         template <typename V = Value>
@@ -118,7 +185,7 @@ namespace bdtree {
         bool erase(const Key& key) {
             key_compare<Key, Value> comp;
             delete_operation<Key, Value> op(key, comp);
-            return exec_leaf_operation(key, backend_, cache_, tx_id_, op);
+            return exec_leaf_operation(key, *backend_, *cache_, tx_id_, op, finger_.get());
         }
 
         //bool remove_if_unmodified(iterator& iter) {
@@ -126,24 +193,69 @@ namespace bdtree {
         //}
 
         void print_statistics() {
-            auto& node_table = backend_.get_node_table();
-            uint64_t max_node = node_table.get_remote_ptr().value;
-            std::vector<uint64_t> counts(uint8_t(node_type_t::MergeDelta) + 1);
-            for (uint64_t i = 1; i <= max_node ; ++i) {
-                physical_pointer pptr{i};
+            auto& ptr_table = backend_->get_ptr_table();
+            auto& node_table = backend_->get_node_table();
+            std::vector<uint64_t> counts(uint8_t(node_type_t::ValueBlob) + 1);
+            // the nodes are found from the pointer table: a scan up to get_remote_ptr of the node table misses the
+            // reused slots of the memory backend, whose physical pointers carry a generation in their upper bits
+            std::vector<physical_pointer> pending;
+            auto visit_value = [&pending](physical_pointer ref) {
+                pending.push_back(ref);
+                return ref;
+            };
+            uint64_t max_lptr = ptr_table.get_remote_ptr().value;
+            for (uint64_t lptr = 1; lptr <= max_lptr; ++lptr) {
                 std::error_code ec;
-                auto buf = node_table.read(pptr, ec);
+                auto entry = ptr_table.read(logical_pointer{lptr}, ec);
                 if (ec)
                     continue;
-                auto* node = deserialize<Key, Value>(reinterpret_cast<const uint8_t*>(buf.data()), buf.length(), pptr);
-                if (node->get_node_type() == node_type_t::LeafNode) {
-                    std::cout << "found leaf_node with pptr: " << pptr.value << std::endl;
-                } else if (node->get_node_type() == node_type_t::InsertDelta) {
-                    auto* ins_delta = reinterpret_cast<insert_delta<Key,Value>*>(node);
-                    std::cout << "found insert_delta with pptr: " << pptr.value << " pointing to " << ins_delta->next.value << std::endl;
+                pending.push_back(std::get<0>(entry));
+                while (!pending.empty()) {
+                    auto pptr = pending.back();
+                    pending.pop_back();
+                    auto buf = node_table.read(pptr, ec);
+                    if (ec) {
+                        ec = std::error_code();
+                        continue;
+                    }
+                    if (node_type_t(uint8_t(buf.data()[0])) == node_type_t::ValueBlob) {
+                        counts[uint8_t(node_type_t::ValueBlob)]++;
+                        continue;
+                    }
+                    auto* node = deserialize<Key, Value>(buf, pptr);
+                    switch (node->get_node_type()) {
+                    case node_type_t::LeafNode:
+                        std::cout << "found leaf_node with pptr: " << pptr.value << std::endl;
+                        for (auto& e : static_cast<leaf_node<Key, Value>*>(node)->array_) {
+                            value_storage<Value>::relocate(e.second, visit_value);
+                        }
+                        break;
+                    case node_type_t::InsertDelta: {
+                        auto* ins_delta = static_cast<insert_delta<Key, Value>*>(node);
+                        std::cout << "found insert_delta with pptr: " << pptr.value << " pointing to " << ins_delta->next.value << std::endl;
+                        value_storage<Value>::relocate(ins_delta->value.second, visit_value);
+                        pending.push_back(ins_delta->next);
+                        break;
+                    }
+                    case node_type_t::DeleteDelta:
+                        pending.push_back(static_cast<delete_delta<Key, Value>*>(node)->next);
+                        break;
+                    case node_type_t::SplitDelta:
+                        pending.push_back(static_cast<split_delta<Key, Value>*>(node)->next);
+                        break;
+                    case node_type_t::RemoveDelta:
+                        pending.push_back(static_cast<remove_delta<Key, Value>*>(node)->next);
+                        break;
+                    case node_type_t::MergeDelta:
+                        pending.push_back(static_cast<merge_delta<Key, Value>*>(node)->next);
+                        pending.push_back(static_cast<merge_delta<Key, Value>*>(node)->rm_next);
+                        break;
+                    default:
+                        break;
+                    }
+                    counts[uint8_t(node->get_node_type())]++;
+                    delete node;
                 }
-                counts[uint8_t(node->get_node_type())]++;
-                delete node;
             }
             auto iter = find(null_key<Key>::value());
             auto* last_current = iter.current_;
@@ -190,6 +302,7 @@ namespace bdtree {
     template<typename Key, typename Value, typename Backend>
     void init(Backend& backend, logical_table_cache<Key, Value, Backend>& cache) {
         auto& node_table = backend.get_node_table();
+        // the root takes the first pointers of both tables, so they do not come from a lease
         auto root_pptr = node_table.get_next_ptr();
         assert(root_pptr == physical_pointer{1});
         leaf_node<Key, Value>* node = new leaf_node<Key, Value>(root_pptr);
@@ -206,7 +319,7 @@ namespace bdtree {
         }
 
         // ptr to root (lptr{1} -> pptr{1})
-        auto last_tx_id = get_last_tx_id();
+        auto last_tx_id = tx_id_source(backend).last();
 
         auto& ptr_table = backend.get_ptr_table();
         auto root_lptr = ptr_table.get_next_ptr();
@@ -0,0 +1,323 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <bdtree/base_backend.h>
+#include <bdtree/primitive_types.h>
+
+#include <crossbow/non_copyable.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+#include <tuple>
+#include <utility>
+
+namespace bdtree {
+
+/**
+ * @brief The calls a decorated backend passes through its hook
+ *
+ * ptr_next and node_next cover both get_next_ptr and reserve_ptrs, one lease of pointers is one call.
+ */
+enum class backend_call : uint8_t {
+    ptr_next,
+    ptr_read,
+    ptr_insert,
+    ptr_update,
+    ptr_remove,
+    node_next,
+    node_read,
+    node_insert,
+    node_remove,
+};
+
+constexpr size_t num_backend_calls = 9;
+
+inline const char* to_string(backend_call call) {
+    switch (call) {
+    case backend_call::ptr_next:
+        return "ptr_next";
+    case backend_call::ptr_read:
+        return "ptr_read";
+    case backend_call::ptr_insert:
+        return "ptr_insert";
+    case backend_call::ptr_update:
+        return "ptr_update";
+    case backend_call::ptr_remove:
+        return "ptr_remove";
+    case backend_call::node_next:
+        return "node_next";
+    case backend_call::node_read:
+        return "node_read";
+    case backend_call::node_insert:
+        return "node_insert";
+    case backend_call::node_remove:
+        return "node_remove";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief A finished call, as handed to the hook
+ */
+struct backend_call_info {
+    backend_call call;
+
+    // the pointer the call is about, for ptr_next and node_next the (first) pointer returned
+    uint64_t ptr = 0;
+
+    // the physical pointer of a pointer table call, the length of a node table call, the number of pointers reserved
+    // for ptr_next and node_next (0 for get_next_ptr)
+    uint64_t value = 0;
+
+    // the version passed to update and remove or returned by read and insert
+    uint64_t version = 0;
+
+    // bytes a remote backend would send to and receive from the table
+    size_t request_length = 0;
+    size_t response_length = 0;
+
+    std::error_code ec;
+
+    backend_call_info(backend_call call, uint64_t ptr, uint64_t value, uint64_t version, size_t request_length,
+            size_t response_length, const std::error_code& ec)
+            : call(call), ptr(ptr), value(value), version(version), request_length(request_length),
+              response_length(response_length), ec(ec) {
+    }
+};
+
+namespace detail {
+
+// bytes of a pointer table entry on the wire
+constexpr size_t ptr_entry_length = sizeof(uint64_t) * 3;
+
+} // namespace detail
+
+/**
+ * @brief Pointer table passing the calls to the pointer table of another backend through a hook
+ *
+ * The hook provides pending_call begin(backend_call call, size_t request_length), called before the wrapped table
+ * is, and void end(pending_call& pending, const backend_call_info& info), called after it returned.
+ */
+template <typename PtrTable, typename Hook>
+class decorated_ptr_table : public base_ptr_table<decorated_ptr_table<PtrTable, Hook>>,
+        crossbow::non_copyable, crossbow::non_movable {
+    typedef base_ptr_table<decorated_ptr_table<PtrTable, Hook>> base;
+
+public:
+    decorated_ptr_table(PtrTable& table, Hook& hook)
+            : table_(table), hook_(hook) {
+    }
+
+    logical_pointer get_next_ptr() {
+        auto pending = hook_.begin(backend_call::ptr_next, 0);
+        auto res = table_.get_next_ptr();
+        hook_.end(pending, backend_call_info(backend_call::ptr_next, res.value, 0, 0, 0, sizeof(uint64_t),
+                std::error_code()));
+        return res;
+    }
+
+    template <typename T = PtrTable>
+    auto reserve_ptrs(uint64_t count) -> decltype(std::declval<T&>().reserve_ptrs(count)) {
+        auto pending = hook_.begin(backend_call::ptr_next, sizeof(uint64_t));
+        auto res = table_.reserve_ptrs(count);
+        hook_.end(pending, backend_call_info(backend_call::ptr_next, res.value, count, 0, sizeof(uint64_t),
+                sizeof(uint64_t), std::error_code()));
+        return res;
+    }
+
+    logical_pointer get_remote_ptr() {
+        return table_.get_remote_ptr();
+    }
+
+    std::tuple<physical_pointer, uint64_t> read(logical_pointer lptr, std::error_code& ec) {
+        auto pending = hook_.begin(backend_call::ptr_read, sizeof(uint64_t));
+        auto res = table_.read(lptr, ec);
+        hook_.end(pending, backend_call_info(backend_call::ptr_read, lptr.value, std::get<0>(res).value,
+                std::get<1>(res), sizeof(uint64_t), detail::ptr_entry_length, ec));
+        return res;
+    }
+
+    using base::read;
+
+    uint64_t insert(logical_pointer lptr, physical_pointer pptr, std::error_code& ec) {
+        auto pending = hook_.begin(backend_call::ptr_insert, detail::ptr_entry_length);
+        auto res = table_.insert(lptr, pptr, ec);
+        hook_.end(pending, backend_call_info(backend_call::ptr_insert, lptr.value, pptr.value, res,
+                detail::ptr_entry_length, sizeof(uint64_t), ec));
+        return res;
+    }
+
+    using base::insert;
+
+    uint64_t update(logical_pointer lptr, physical_pointer pptr, uint64_t version, std::error_code& ec) {
+        auto pending = hook_.begin(backend_call::ptr_update, detail::ptr_entry_length);
+        auto res = table_.update(lptr, pptr, version, ec);
+        hook_.end(pending, backend_call_info(backend_call::ptr_update, lptr.value, pptr.value, version,
+                detail::ptr_entry_length, sizeof(uint64_t), ec));
+        return res;
+    }
+
+    using base::update;
+
+    void remove(logical_pointer lptr, uint64_t version, std::error_code& ec) {
+        auto pending = hook_.begin(backend_call::ptr_remove, sizeof(uint64_t) * 2);
+        table_.remove(lptr, version, ec);
+        hook_.end(pending, backend_call_info(backend_call::ptr_remove, lptr.value, 0, version, sizeof(uint64_t) * 2,
+                0, ec));
+    }
+
+    using base::remove;
+
+private:
+    PtrTable& table_;
+    Hook& hook_;
+};
+
+/**
+ * @brief Node table passing the calls to the node table of another backend through a hook, see decorated_ptr_table
+ *
+ * Reads return the result of the wrapped table, zero-copy results stay zero-copy.
+ */
+template <typename NodeTable, typename Hook>
+class decorated_node_table : public base_node_table<decorated_node_table<NodeTable, Hook>,
+        decltype(std::declval<NodeTable&>().read(physical_pointer(), std::declval<std::error_code&>()))>,
+        crossbow::non_copyable, crossbow::non_movable {
+    typedef decltype(std::declval<NodeTable&>().read(physical_pointer(), std::declval<std::error_code&>())) data_type;
+    typedef base_node_table<decorated_node_table<NodeTable, Hook>, data_type> base;
+
+public:
+    decorated_node_table(NodeTable& table, Hook& hook)
+            : table_(table), hook_(hook) {
+    }
+
+    physical_pointer get_next_ptr() {
+        auto pending = hook_.begin(backend_call::node_next, 0);
+        auto res = table_.get_next_ptr();
+        hook_.end(pending, backend_call_info(backend_call::node_next, res.value, 0, 0, 0, sizeof(uint64_t),
+                std::error_code()));
+        return res;
+    }
+
+    template <typename T = NodeTable>
+    auto reserve_ptrs(uint64_t count) -> decltype(std::declval<T&>().reserve_ptrs(count)) {
+        auto pending = hook_.begin(backend_call::node_next, sizeof(uint64_t));
+        auto res = table_.reserve_ptrs(count);
+        hook_.end(pending, backend_call_info(backend_call::node_next, res.value, count, 0, sizeof(uint64_t),
+                sizeof(uint64_t), std::error_code()));
+        return res;
+    }
+
+    physical_pointer get_remote_ptr() {
+        return table_.get_remote_ptr();
+    }
+
+    data_type read(physical_pointer pptr, std::error_code& ec) {
+        auto pending = hook_.begin(backend_call::node_read, sizeof(uint64_t));
+        auto res = table_.read(pptr, ec);
+        auto length = ec ? 0 : res.length();
+        hook_.end(pending, backend_call_info(backend_call::node_read, pptr.value, length, 0, sizeof(uint64_t),
+                length, ec));
+        return res;
+    }
+
+    using base::read;
+
+    void insert(physical_pointer pptr, const char* data, size_t length, std::error_code& ec) {
+        auto pending = hook_.begin(backend_call::node_insert, sizeof(uint64_t) + length);
+        table_.insert(pptr, data, length, ec);
+        hook_.end(pending, backend_call_info(backend_call::node_insert, pptr.value, length, 0,
+                sizeof(uint64_t) + length, 0, ec));
+    }
+
+    using base::insert;
+
+    void remove(physical_pointer pptr, std::error_code& ec) {
+        auto pending = hook_.begin(backend_call::node_remove, sizeof(uint64_t));
+        table_.remove(pptr, ec);
+        hook_.end(pending, backend_call_info(backend_call::node_remove, pptr.value, 0, 0, sizeof(uint64_t), 0, ec));
+    }
+
+    using base::remove;
+
+private:
+    NodeTable& table_;
+    Hook& hook_;
+};
+
+/**
+ * @brief Backend passing every table call of another backend through a hook
+ *
+ * The hook is constructed from the first argument, the wrapped backend from the remaining ones. Tx ids come from
+ * the wrapped backend and do not go through the hook.
+ */
+template <typename Backend, typename Hook>
+class decorated_backend : crossbow::non_copyable, crossbow::non_movable {
+public:
+    using ptr_table = decorated_ptr_table<typename Backend::ptr_table, Hook>;
+
+    using node_table = decorated_node_table<typename Backend::node_table, Hook>;
+
+    template <typename HookArg, typename... Args>
+    explicit decorated_backend(HookArg&& hook_arg, Args&&... args)
+            : backend_(std::forward<Args>(args)...),
+              hook_(std::forward<HookArg>(hook_arg)),
+              ptr_(backend_.get_ptr_table(), hook_),
+              node_(backend_.get_node_table(), hook_) {
+    }
+
+    ptr_table& get_ptr_table() {
+        return ptr_;
+    }
+
+    node_table& get_node_table() {
+        return node_;
+    }
+
+    template <typename T = Backend>
+    auto get_tx_id_source() -> decltype(std::declval<T&>().get_tx_id_source()) {
+        return backend_.get_tx_id_source();
+    }
+
+    Backend& get_backend() {
+        return backend_;
+    }
+
+protected:
+    Hook& hook() {
+        return hook_;
+    }
+
+    const Hook& hook() const {
+        return hook_;
+    }
+
+private:
+    Backend backend_;
+    Hook hook_;
+    ptr_table ptr_;
+    node_table node_;
+};
+
+} // namespace bdtree
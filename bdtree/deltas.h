@@ -23,6 +23,7 @@
 #pragma once
 #include "forward_declarations.h"
 #include "base_types.h"
+#include "node_format.h"
 
 namespace bdtree {
 
@@ -30,6 +31,7 @@ template<typename Key, typename Value>
 struct insert_delta_t : public node<Key, Value>
 {
     static constexpr node_type_t node_type = node_type_t::InsertDelta;
+    static constexpr uint8_t supported_formats = node_format::compact_pointers;
     std::pair<Key, Value> value;
     physical_pointer next;
 
@@ -38,12 +40,26 @@ struct insert_delta_t : public node<Key, Value>
         ar & this->value;
         ar & this->next;
     }
+
+    template<typename Writer>
+    void encode(Writer& w, uint8_t flags) const {
+        single_key_codec<Key>::encode(w, this->value.first);
+        w.put(this->value.second);
+        encode_pointer(w, this->next, flags);
+    }
+
+    void decode(wire_reader& r, uint8_t flags) {
+        single_key_codec<Key>::decode(r, this->value.first);
+        r.get(this->value.second);
+        decode_pointer(r, this->next, flags);
+    }
 };
 
 template<typename Key, typename Value>
 struct delete_delta_t : public node<Key, Value>
 {
     static constexpr node_type_t node_type = node_type_t::DeleteDelta;
+    static constexpr uint8_t supported_formats = node_format::compact_pointers;
     Key key;
     physical_pointer next;
 
@@ -52,12 +68,24 @@ struct delete_delta_t : public node<Key, Value>
         ar & this->key;
         ar & this->next;
     }
+
+    template<typename Writer>
+    void encode(Writer& w, uint8_t flags) const {
+        single_key_codec<Key>::encode(w, this->key);
+        encode_pointer(w, this->next, flags);
+    }
+
+    void decode(wire_reader& r, uint8_t flags) {
+        single_key_codec<Key>::decode(r, this->key);
+        decode_pointer(r, this->next, flags);
+    }
 };
 
 template<typename Key, typename Value>
 struct split_delta_t : public node<Key, Value>
 {
     static constexpr node_type_t node_type = node_type_t::SplitDelta;
+    static constexpr uint8_t supported_formats = node_format::compact_pointers;
     physical_pointer next;
     logical_pointer new_right;
     Key right_key;
@@ -71,12 +99,29 @@ struct split_delta_t : public node<Key, Value>
         ar & this->level;
         assert(this->level >= 0);
     }
+
+    template<typename Writer>
+    void encode(Writer& w, uint8_t flags) const {
+        encode_pointer(w, this->next, flags);
+        encode_pointer(w, this->new_right, flags);
+        single_key_codec<Key>::encode(w, this->right_key);
+        w.put(this->level);
+    }
+
+    void decode(wire_reader& r, uint8_t flags) {
+        decode_pointer(r, this->next, flags);
+        decode_pointer(r, this->new_right, flags);
+        single_key_codec<Key>::decode(r, this->right_key);
+        r.get(this->level);
+        assert(this->level >= 0);
+    }
 };
 
 template<typename Key, typename Value>
 struct remove_delta_t : public node<Key, Value>
 {
     static constexpr node_type_t node_type = node_type_t::RemoveDelta;
+    static constexpr uint8_t supported_formats = node_format::compact_pointers;
     Key low_key;
     physical_pointer next;
     int8_t level = -1;
@@ -88,12 +133,27 @@ struct remove_delta_t : public node<Key, Value>
         ar & this->level;
         assert(this->level >= 0);
     }
+
+    template<typename Writer>
+    void encode(Writer& w, uint8_t flags) const {
+        single_key_codec<Key>::encode(w, this->low_key);
+        encode_pointer(w, this->next, flags);
+        w.put(this->level);
+    }
+
+    void decode(wire_reader& r, uint8_t flags) {
+        single_key_codec<Key>::decode(r, this->low_key);
+        decode_pointer(r, this->next, flags);
+        r.get(this->level);
+        assert(this->level >= 0);
+    }
 };
 
 template<typename Key, typename Value>
 struct merge_delta_t : public node<Key, Value>
 {
     static constexpr node_type_t node_type = node_type_t::MergeDelta;
+    static constexpr uint8_t supported_formats = node_format::compact_pointers;
     physical_pointer next;
     logical_pointer rmdelta;
     physical_pointer rmdeltapptr;
@@ -111,6 +171,26 @@ struct merge_delta_t : public node<Key, Value>
         ar & this->level;
         assert(this->level >= 0);
     }
+
+    template<typename Writer>
+    void encode(Writer& w, uint8_t flags) const {
+        single_key_codec<Key>::encode(w, this->right_low_key);
+        encode_pointer(w, this->rmdelta, flags);
+        encode_pointer(w, this->rmdeltapptr, flags);
+        encode_pointer(w, this->next, flags);
+        encode_pointer(w, this->rm_next, flags);
+        w.put(this->level);
+    }
+
+    void decode(wire_reader& r, uint8_t flags) {
+        single_key_codec<Key>::decode(r, this->right_low_key);
+        decode_pointer(r, this->rmdelta, flags);
+        decode_pointer(r, this->rmdeltapptr, flags);
+        decode_pointer(r, this->next, flags);
+        decode_pointer(r, this->rm_next, flags);
+        r.get(this->level);
+        assert(this->level >= 0);
+    }
 };
 
 }
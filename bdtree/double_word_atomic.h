@@ -0,0 +1,63 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <new>
+
+namespace bdtree {
+
+template<typename T>
+struct double_word_atomic {
+private:
+    __int128 data;
+public:
+    double_word_atomic() {
+        new (&data)T();
+    }
+    static_assert(sizeof(T) <= 16, "Type is too big");
+    static_assert(sizeof(T) > 8, "One should not use double_word_atomic for types smaller than 8");
+
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wstrict-aliasing"
+#endif
+    T load() {
+        __int128 res = __atomic_load_n(&data, __ATOMIC_SEQ_CST);
+        return reinterpret_cast<T&>(res);
+    }
+    void store(T desired) {
+        __atomic_store_n(&data, reinterpret_cast<__int128&>(desired), __ATOMIC_SEQ_CST);
+    }
+
+    bool cas(T& expected, T desired) {
+        return __atomic_compare_exchange(&data, reinterpret_cast<__int128*>(&expected), reinterpret_cast<__int128*>(&desired), false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+};
+
+} // namespace bdtree
@@ -0,0 +1,293 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <bdtree/base_backend.h>
+#include <bdtree/error_code.h>
+#include <bdtree/io_engine.h>
+#include <bdtree/memory_backend.h>
+#include <bdtree/node_data.h>
+#include <bdtree/primitive_types.h>
+
+#include <crossbow/non_copyable.hpp>
+
+#include <tbb/spin_rw_mutex.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace bdtree {
+
+struct file_backend_config {
+    // whether writes return only once they are on stable storage, otherwise once the kernel has them
+    bool sync = true;
+
+    // number of pointer table log records after which the pointer table is checkpointed
+    uint64_t checkpoint_interval = 1 << 20;
+
+    // entries of the io_uring the files are accessed through, 0 uses blocking system calls
+    unsigned io_queue_depth = 0;
+
+    // buffers of io_buffer_size bytes registered with the io_uring
+    unsigned io_registered_buffers = 0;
+    size_t io_buffer_size = 4096;
+};
+
+namespace detail {
+
+/**
+ * @brief Append-only file with group commit
+ *
+ * Concurrent appends are collected in a buffer. The first appender finding no write in progress writes the whole buffer
+ * with one write and one sync while the others wait for it; appends arriving meanwhile form the next group.
+ */
+class log_file : crossbow::non_copyable, crossbow::non_movable {
+public:
+    log_file(const std::string& path, bool sync, io_engine& io);
+
+    ~log_file();
+
+    /**
+     * @brief Appends a record and returns its offset
+     *
+     * With wait the call returns once the record is written (and synced), otherwise it is written with a later group.
+     */
+    uint64_t append(const char* header, size_t header_length, const char* data, size_t length, bool wait = true);
+
+    void read(uint64_t offset, char* buffer, size_t length) const;
+
+    /**
+     * @brief Cuts the file, only used before the first append
+     */
+    void truncate(uint64_t size);
+
+    uint64_t size() const {
+        return end_;
+    }
+
+private:
+    void write_group(std::unique_lock<std::mutex>& lock);
+
+    int fd_;
+    bool sync_;
+    io_engine& io_;
+    std::mutex mutex_;
+    std::condition_variable written_;
+    std::vector<char> pending_;
+    std::vector<char> writing_;
+    uint64_t end_;
+    uint64_t written_end_;
+    bool write_in_progress_ = false;
+    std::error_code error_;
+};
+
+} // namespace detail
+
+/**
+ * @brief Node table appending the nodes to a log file
+ *
+ * An index in memory maps physical pointers to their record in the log. Removing a node appends a tombstone, space of
+ * removed nodes is not reclaimed. On construction the log is scanned to rebuild the index and cut off a torn tail.
+ */
+class file_node_table : public base_node_table<file_node_table, shared_node_data>,
+        crossbow::non_copyable, crossbow::non_movable {
+public:
+    file_node_table(const std::string& path, bool sync, io_engine& io);
+
+    physical_pointer get_next_ptr() {
+        return {++counter_};
+    }
+
+    physical_pointer reserve_ptrs(uint64_t count) {
+        return {counter_.fetch_add(count) + 1};
+    }
+
+    physical_pointer get_remote_ptr() {
+        return {counter_.load()};
+    }
+
+    shared_node_data read(physical_pointer pptr, std::error_code& ec);
+
+    using base_node_table<file_node_table, shared_node_data>::read;
+
+    void insert(physical_pointer pptr, const char* data, size_t length, std::error_code& ec);
+
+    using base_node_table<file_node_table, shared_node_data>::insert;
+
+    void remove(physical_pointer pptr, std::error_code& ec);
+
+    using base_node_table<file_node_table, shared_node_data>::remove;
+
+    bool empty() const {
+        return index_.empty();
+    }
+
+private:
+    struct location {
+        uint64_t offset;
+        uint32_t length;
+    };
+
+    void recover(const std::string& path);
+
+    detail::log_file log_;
+    std::atomic<uint64_t> counter_;
+    tbb::spin_rw_mutex index_mutex_;
+    std::unordered_map<uint64_t, location> index_;
+};
+
+/**
+ * @brief Pointer table kept in memory and persisted through a write-ahead log
+ *
+ * Changes are logged and then applied to a memory_ptr_table, writers of the same pointer are serialized so the
+ * version is known before the record is written. Log records carry the resulting version, so replaying them in any
+ * order gives the newest entry of every pointer. After checkpoint_interval records a background thread writes the table
+ * to a checkpoint and starts a new log; recovery loads the checkpoint and replays the logs written since.
+ */
+class file_ptr_table : public base_ptr_table<file_ptr_table>, crossbow::non_copyable, crossbow::non_movable {
+public:
+    file_ptr_table(const std::string& directory, const file_backend_config& config, io_engine& io);
+
+    ~file_ptr_table();
+
+    logical_pointer get_next_ptr() {
+        return table_.get_next_ptr();
+    }
+
+    logical_pointer reserve_ptrs(uint64_t count) {
+        return table_.reserve_ptrs(count);
+    }
+
+    logical_pointer get_remote_ptr() {
+        return table_.get_remote_ptr();
+    }
+
+    std::tuple<physical_pointer, uint64_t> read(logical_pointer lptr, std::error_code& ec) {
+        return table_.read(lptr, ec);
+    }
+
+    using base_ptr_table<file_ptr_table>::read;
+
+    uint64_t insert(logical_pointer lptr, physical_pointer pptr, std::error_code& ec);
+
+    using base_ptr_table<file_ptr_table>::insert;
+
+    uint64_t update(logical_pointer lptr, physical_pointer pptr, uint64_t version, std::error_code& ec);
+
+    using base_ptr_table<file_ptr_table>::update;
+
+    void remove(logical_pointer lptr, uint64_t version, std::error_code& ec);
+
+    using base_ptr_table<file_ptr_table>::remove;
+
+    /**
+     * @brief Writes the table to a new checkpoint and drops the logs it covers
+     */
+    void checkpoint();
+
+private:
+    /**
+     * @brief Writes a record and returns the log it went to
+     *
+     * The caller holds the log until the change is applied to the table, a checkpoint waits for that before it copies
+     * the table.
+     */
+    std::shared_ptr<detail::log_file> log(uint8_t op, logical_pointer lptr, physical_pointer pptr, uint64_t version);
+
+    void recover();
+
+    std::shared_ptr<detail::log_file> current_log();
+
+    std::mutex& write_mutex(logical_pointer lptr) {
+        return write_mutexes_[lptr.value % write_mutexes_.size()];
+    }
+
+    void run_checkpoints();
+
+    memory_ptr_table table_;
+    std::string directory_;
+    file_backend_config config_;
+    io_engine& io_;
+    std::mutex log_mutex_;
+    std::shared_ptr<detail::log_file> log_;
+    uint64_t log_seq_ = 0;
+    uint64_t first_log_seq_ = 0;
+    std::atomic<uint64_t> records_{0};
+    std::mutex checkpoint_mutex_;
+    std::array<std::mutex, 64> write_mutexes_;
+    std::mutex checkpointer_mutex_;
+    std::condition_variable checkpointer_wakeup_;
+    bool checkpoint_requested_ = false;
+    bool stop_ = false;
+    std::thread checkpointer_;
+};
+
+/**
+ * @brief Backend storing the tree in files of a directory
+ *
+ * A tree written by one instance is found by the next instance opened on the same directory; the map has to be
+ * initialized only if the backend is empty.
+ */
+class file_backend : crossbow::non_copyable, crossbow::non_movable {
+public:
+    using ptr_table = file_ptr_table;
+
+    using node_table = file_node_table;
+
+    explicit file_backend(const std::string& directory, const file_backend_config& config = file_backend_config());
+
+    ptr_table& get_ptr_table() {
+        return ptr_;
+    }
+
+    node_table& get_node_table() {
+        return node_;
+    }
+
+    bool empty() const {
+        return node_.empty();
+    }
+
+    io_engine& get_io_engine() {
+        return io_;
+    }
+
+private:
+    static const std::string& create_directory(const std::string& directory);
+
+    io_engine io_;
+    file_node_table node_;
+    file_ptr_table ptr_;
+};
+
+} // namespace bdtree
@@ -0,0 +1,321 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <bdtree/base_backend.h>
+#include <bdtree/base_types.h>
+#include <bdtree/error_code.h>
+#include <bdtree/logical_table_cache.h>
+#include <bdtree/node_data.h>
+#include <bdtree/node_pointer.h>
+#include <bdtree/nodes.h>
+#include <bdtree/primitive_types.h>
+#include <bdtree/separated_value.h>
+#include <bdtree/tx_id_source.h>
+
+#include <crossbow/non_copyable.hpp>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
+
+namespace bdtree {
+namespace detail {
+
+constexpr uint64_t image_magic = 0x31474d4945455254ull; // "TREEIMG1"
+
+/**
+ * @brief Layout of a tree image
+ *
+ * The header is followed by the nodes, root first and level by level, each as a consolidated serialized node aligned
+ * to 8 bytes. The table at table_offset holds an image_entry for every logical pointer up to max_lptr, entries of
+ * pointers that are not in the tree have length 0. Values a leaf stores out of line (separated_value) are objects of
+ * their own, written before their leaf and numbered after the logical pointers of the tree; the leaf refers to them by
+ * that number.
+ */
+struct image_header {
+    uint64_t magic;
+    uint64_t nodes;
+    uint64_t max_lptr;
+    uint64_t table_offset;
+};
+
+struct image_entry {
+    uint64_t offset;
+    uint64_t length;
+};
+
+/**
+ * @brief Read-only mapping of a whole file
+ */
+class mapped_file {
+public:
+    explicit mapped_file(const std::string& path);
+
+    // the mapping, it is unmapped when the last copy of the pointer is gone
+    const std::shared_ptr<const char>& data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    std::shared_ptr<const char> data_;
+    size_t size_;
+};
+
+inline std::error_code read_only_error() {
+    return std::make_error_code(std::errc::read_only_file_system);
+}
+
+} // namespace detail
+
+/**
+ * @brief Writes the tree to an image file that image_backend serves
+ *
+ * Every node is written as it is resolved from the backend, after its deltas are applied. The tree must not be
+ * modified while the image is written, otherwise the image may mix states of the tree or the export may fail.
+ */
+template <typename Key, typename Value, typename Backend>
+void write_image(Backend& backend, logical_table_cache<Key, Value, Backend>& cache, const std::string& path) {
+    operation_context<Key, Value, Backend> context{backend, cache, next_tx_id(backend)};
+    auto tmp_path = path + ".tmp";
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    detail::image_header header{detail::image_magic, 0, 0, sizeof(detail::image_header)};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<detail::image_entry> table;
+    auto append = [&out, &header, &table](uint64_t index, const char* data, size_t length) {
+        if (table.size() <= index) {
+            table.resize(index + 1, detail::image_entry{0, 0});
+        }
+        table[index] = detail::image_entry{header.table_offset, length};
+        out.write(data, length);
+        static const char padding[8] = {};
+        auto padded = (length + 7) / 8 * 8;
+        out.write(padding, padded - length);
+        header.table_offset += padded;
+        ++header.nodes;
+    };
+    // out of line values get the numbers after every logical pointer handed out so far
+    uint64_t first_value = backend.get_ptr_table().get_remote_ptr().value + 1;
+    uint64_t next_value = first_value;
+    auto copy_value = [&backend, &append, &next_value](physical_pointer ref) {
+        auto buf = backend.get_node_table().read(ref);
+        append(next_value, buf.data(), buf.length());
+        return physical_pointer{next_value++};
+    };
+
+    std::vector<uint8_t> data;
+    std::vector<logical_pointer> level{logical_pointer{1}};
+    std::unordered_set<uint64_t> seen{1};
+    while (!level.empty()) {
+        std::vector<logical_pointer> next_level;
+        // nodes split after their parent was read are only reachable through the right link
+        for (size_t i = 0; i < level.size(); ++i) {
+            auto np = cache.get_without_cache(level[i], context);
+            if (np == nullptr) {
+                throw std::runtime_error("tree modified while writing the image");
+            }
+            data.clear();
+            logical_pointer right_link;
+            if (level[i].value >= first_value) {
+                throw std::runtime_error("tree modified while writing the image");
+            }
+            if (np->node_->get_node_type() == node_type_t::LeafNode) {
+                auto leaf = np->as_leaf();
+                if (value_storage<Value>::separates) {
+                    leaf_node<Key, Value> copy(*leaf);
+                    for (auto& entry : copy.array_) {
+                        value_storage<Value>::relocate(entry.second, copy_value);
+                    }
+                    copy.serialize_into(data);
+                } else {
+                    leaf->serialize_into(data);
+                }
+                right_link = leaf->right_link_;
+            } else {
+                auto inner = np->as_inner();
+                inner->serialize_into(data);
+                right_link = inner->right_link_;
+                for (auto& child : inner->array_) {
+                    if (seen.insert(child.second.value).second) {
+                        next_level.push_back(child.second);
+                    }
+                }
+            }
+            if (right_link.value != 0 && seen.insert(right_link.value).second) {
+                level.push_back(right_link);
+            }
+            append(level[i].value, reinterpret_cast<const char*>(data.data()), data.size());
+        }
+        level.swap(next_level);
+    }
+    header.max_lptr = table.size() - 1;
+    out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(detail::image_entry));
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+    if (!out) {
+        throw std::system_error(std::make_error_code(std::errc::io_error), "writing " + tmp_path);
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        throw std::system_error(errno, std::system_category(), "rename " + path);
+    }
+}
+
+/**
+ * @brief Pointer table of an image, every logical pointer maps to the physical pointer of the same value
+ */
+class image_ptr_table : public base_ptr_table<image_ptr_table> {
+public:
+    explicit image_ptr_table(const detail::mapped_file& file);
+
+    logical_pointer get_next_ptr() {
+        throw std::system_error(detail::read_only_error());
+    }
+
+    logical_pointer get_remote_ptr() {
+        return {max_lptr_};
+    }
+
+    std::tuple<physical_pointer, uint64_t> read(logical_pointer lptr, std::error_code& ec) {
+        if (lptr.value > max_lptr_ || table_[lptr.value].length == 0) {
+            ec = make_error_code(error::object_doesnt_exist);
+            return std::make_tuple(physical_pointer{0}, uint64_t(0));
+        }
+        return std::make_tuple(physical_pointer{lptr.value}, uint64_t(1));
+    }
+
+    using base_ptr_table<image_ptr_table>::read;
+
+    uint64_t insert(logical_pointer, physical_pointer, std::error_code& ec) {
+        ec = detail::read_only_error();
+        return 0;
+    }
+
+    using base_ptr_table<image_ptr_table>::insert;
+
+    uint64_t update(logical_pointer, physical_pointer, uint64_t, std::error_code& ec) {
+        ec = detail::read_only_error();
+        return 0;
+    }
+
+    using base_ptr_table<image_ptr_table>::update;
+
+    void remove(logical_pointer, uint64_t, std::error_code& ec) {
+        ec = detail::read_only_error();
+    }
+
+    using base_ptr_table<image_ptr_table>::remove;
+
+private:
+    const detail::image_entry* table_;
+    uint64_t max_lptr_;
+};
+
+/**
+ * @brief Node table of an image, reads return views into the mapping
+ *
+ * Leaves decoded from a view keep their value block in the mapping instead of copying it, see shared_node_data.
+ */
+class image_node_table : public base_node_table<image_node_table, shared_node_data> {
+public:
+    explicit image_node_table(const detail::mapped_file& file);
+
+    physical_pointer get_next_ptr() {
+        throw std::system_error(detail::read_only_error());
+    }
+
+    physical_pointer get_remote_ptr() {
+        return {max_lptr_};
+    }
+
+    shared_node_data read(physical_pointer pptr, std::error_code& ec) {
+        if (pptr.value > max_lptr_ || table_[pptr.value].length == 0) {
+            ec = make_error_code(error::object_doesnt_exist);
+            return shared_node_data();
+        }
+        auto& entry = table_[pptr.value];
+        return shared_node_data(std::shared_ptr<const char>(data_, data_.get() + entry.offset), entry.length);
+    }
+
+    using base_node_table<image_node_table, shared_node_data>::read;
+
+    void insert(physical_pointer, const char*, size_t, std::error_code& ec) {
+        ec = detail::read_only_error();
+    }
+
+    using base_node_table<image_node_table, shared_node_data>::insert;
+
+    void remove(physical_pointer, std::error_code& ec) {
+        ec = detail::read_only_error();
+    }
+
+    using base_node_table<image_node_table, shared_node_data>::remove;
+
+private:
+    std::shared_ptr<const char> data_;
+    const detail::image_entry* table_;
+    uint64_t max_lptr_;
+};
+
+/**
+ * @brief Read-only backend serving a tree from an image written by write_image
+ *
+ * Opening maps the file, nodes are paged in and decoded when a lookup first reaches them. Writes to a map on this
+ * backend throw a std::system_error with std::errc::read_only_file_system.
+ */
+class image_backend : crossbow::non_copyable, crossbow::non_movable {
+public:
+    using ptr_table = image_ptr_table;
+
+    using node_table = image_node_table;
+
+    explicit image_backend(const std::string& path);
+
+    ptr_table& get_ptr_table() {
+        return ptr_;
+    }
+
+    node_table& get_node_table() {
+        return node_;
+    }
+
+private:
+    detail::mapped_file file_;
+    image_ptr_table ptr_;
+    image_node_table node_;
+};
+
+} // namespace bdtree
@@ -0,0 +1,93 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <crossbow/non_copyable.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <sys/types.h>
+
+namespace bdtree {
+
+/**
+ * @brief Counters of an io_engine, latencies are measured from queueing a request to its completion
+ */
+struct io_statistics {
+    uint64_t requests = 0;
+    uint64_t batches = 0;
+    uint64_t max_queue_depth = 0;
+    uint64_t total_latency_ns = 0;
+    uint64_t max_latency_ns = 0;
+};
+
+/**
+ * @brief Executes the reads, writes and syncs of the file backend
+ *
+ * With a queue depth the requests go through an io_uring. Threads queue their request, one thread at a time submits
+ * everything queued with one system call and one thread at a time waits for and reaps the completions of all threads.
+ * Requests of concurrent tree operations therefore share submissions, and a thread waiting for a slow sync does not
+ * hold back the submission of other requests. Reads and writes that fit into a registered buffer are staged through
+ * one. Without a queue depth, or if the kernel has no io_uring, the requests are blocking system calls.
+ *
+ * The calls return like the system calls they replace: -1 with errno set on failure.
+ */
+class io_engine : crossbow::non_copyable, crossbow::non_movable {
+public:
+    explicit io_engine(unsigned queue_depth = 0, unsigned registered_buffers = 0, size_t buffer_size = 4096);
+
+    ~io_engine();
+
+    bool uses_io_uring() const {
+        return ring_ != nullptr;
+    }
+
+    ssize_t pread(int fd, char* buffer, size_t length, uint64_t offset);
+
+    ssize_t pwrite(int fd, const char* buffer, size_t length, uint64_t offset);
+
+    int fdatasync(int fd);
+
+    io_statistics statistics() const;
+
+private:
+    struct ring;
+    struct request;
+
+    ssize_t execute(request& r);
+
+    ssize_t execute_blocking(request& r);
+
+    std::unique_ptr<ring> ring_;
+    std::atomic<uint64_t> requests_{0};
+    std::atomic<uint64_t> batches_{0};
+    std::atomic<uint64_t> queue_depth_{0};
+    std::atomic<uint64_t> max_queue_depth_{0};
+    std::atomic<uint64_t> total_latency_ns_{0};
+    std::atomic<uint64_t> max_latency_ns_{0};
+};
+
+} // namespace bdtree
@@ -28,6 +28,7 @@
 #include <bdtree/base_types.h>
 #include <bdtree/util.h>
 #include <bdtree/merge_operation.h>
+#include <bdtree/separated_value.h>
 
 #include <boost/optional.hpp>
 #include <boost/none.hpp>
@@ -46,7 +47,7 @@ namespace bdtree {
         bdtree_iterator(operation_context<Key, Value, Backend> && context, decltype(current_) n, const Key & key, search_bound bound = search_bound::LAST_SMALLER_EQUAL)
             : context_(std::move(context)), current_(n) {
             assert(current_ != nullptr);
-            current_iterator_ = std::lower_bound(current_->as_leaf()->array_.begin(), current_->as_leaf()->array_.end(), key, cmp_);
+            current_iterator_ = leaf_lower_bound(*current_->as_leaf(), key, cmp_);
             if (bound == search_bound::LAST_SMALLER) {
                 current_iterator_ = (current_iterator_ == current_->as_leaf()->array_.begin() ? current_->as_leaf()->array_.end() : --current_iterator_);
             }
@@ -54,7 +55,7 @@ namespace bdtree {
                 if (set_void_if_after())
                     return;
                 current_ = get_next(*context_, current_);
-                current_iterator_ = std::lower_bound(current_->as_leaf()->array_.begin(), current_->as_leaf()->array_.end(), key, cmp_);
+                current_iterator_ = key_lower_bound(current_->as_leaf()->array_.begin(), current_->as_leaf()->array_.end(), key, cmp_);
             }
         }
         
@@ -70,7 +71,7 @@ namespace bdtree {
             leaf_node<Key, Value>* nl = new leaf_node<Key, Value>(*leaf);
             size_t current_index = current_iterator_ - current_->as_leaf()->array_.begin();
             nl->array_.erase(nl->array_.begin() + current_index);
-            std::vector<uint8_t> data;
+            serialize_buffer data;
             static_assert(CONSOLIDATE_AT == 0 && FakeParam == 1, "bdtree_iterator::erase_if_no_newer cannot correctly handle delta chains");
             assert(nl->deltas_.size() == 0);
             auto s = nl->serialized_size();
@@ -78,14 +79,14 @@ namespace bdtree {
                 merge_operation<Key, Value, Backend>::execute_merge(current_, leaf, *context_);
                 return erase_result::Merged;
             }
-            data = nl->serialize();
+            nl->serialize_into(data.get());
 
             auto& node_table = context_->get_node_table();
-            auto pptr = node_table.get_next_ptr();
+            auto pptr = node_table.next_ptr();
             nl->leaf_pptr_ = pptr;
-            auto last_tx_id = get_last_tx_id();
+            auto last_tx_id = tx_id_source(context_->backend).last();
 
-            node_table.insert(pptr, reinterpret_cast<char*>(data.data()), data.size());
+            node_table.insert(pptr, data.data(), data.size());
 
             auto& ptr_table = context_->get_ptr_table();
             std::error_code ec;
@@ -96,6 +97,7 @@ namespace bdtree {
                 return erase_result::Failed;
             }
 
+            value_storage<Value>::release(leaf->array_[current_index].second, node_table);
             node_pointer<Key, Value>* np = new node_pointer<Key, Value>(current_->lptr_, pptr, lptr_version);
             np->node_ = nl;
             static_assert(CONSOLIDATE_AT == 0 && FakeParam == FakeParam, "bdtree_iterator::erase_if_no_newer cannot correctly handle delta chains");
@@ -150,20 +152,20 @@ namespace bdtree {
 #ifndef NDEBUG
             auto old_current = current_;
 #endif
+            // a leaf emptied by erases stays in the tree until an operation on it merges it, scans skip it
             do {
                 if (set_void_if_after()) {
                     return *this;
                 }
                 current_ = get_next(*context_, current_);
-            } while (false);
-            assert(!current_->as_leaf()->array_.empty());
+            } while (current_->as_leaf()->array_.empty());
             if (current_->as_leaf()->low_key_ == hkey) {
                 current_iterator_ = current_->as_leaf()->array_.begin();
                 return *this;
             }
             assert(old_current->as_leaf()->right_link_ != current_->lptr_ || current_->as_leaf()->low_key_ == hkey);
             for (;;) {
-                current_iterator_ = std::lower_bound(current_->as_leaf()->array_.begin(), current_->as_leaf()->array_.end(), hkey, cmp_);
+                current_iterator_ = key_lower_bound(current_->as_leaf()->array_.begin(), current_->as_leaf()->array_.end(), hkey, cmp_);
                 if (current_iterator_ == current_->as_leaf()->array_.end()) {
                     if (set_void_if_after()) {
                         return *this;
@@ -228,8 +230,15 @@ namespace bdtree {
 
         template <typename V = Value>
         typename std::enable_if<!std::is_same<V, bdtree::empty_t>::value, decltype(*current_iterator_)>::type operator *() const {
+            current_->as_leaf()->load_values();
             return *current_iterator_;
         }
+        /**
+         * @brief Returns the value of the current entry, a separated_value is fetched from the node table
+         */
+        const typename value_storage<Value>::loaded_type& value() const {
+            return value_storage<Value>::load((**this).second, context_->get_node_table());
+        }
         template <typename V = Value>
         typename std::enable_if<std::is_same<V, bdtree::empty_t>::value, const Key*>::type operator ->() const {
             return &(**this);
@@ -0,0 +1,275 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace bdtree {
+
+/**
+ * @brief Key stored as an order preserving byte string
+ *
+ * The bytes are produced by key_encoder so that comparing two normalized keys with memcmp yields the same order as
+ * comparing the original keys. Using normalized_key as the key type of a tree replaces the element wise tuple and
+ * string comparisons in the nodes with a single memcmp per comparison.
+ */
+class normalized_key {
+public:
+    normalized_key() = default;
+
+    explicit normalized_key(std::string bytes)
+            : bytes_(std::move(bytes)) {
+    }
+
+    const std::string& bytes() const {
+        return bytes_;
+    }
+
+    const char* data() const {
+        return bytes_.data();
+    }
+
+    size_t size() const {
+        return bytes_.size();
+    }
+
+    static int compare(const normalized_key& lhs, const normalized_key& rhs) {
+        auto len = std::min(lhs.size(), rhs.size());
+        auto res = std::memcmp(lhs.data(), rhs.data(), len);
+        if (res != 0) {
+            return res;
+        }
+        return (lhs.size() < rhs.size() ? -1 : (lhs.size() == rhs.size() ? 0 : 1));
+    }
+
+    friend bool operator== (const normalized_key& lhs, const normalized_key& rhs) {
+        return lhs.size() == rhs.size() && std::memcmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+    }
+    friend bool operator!= (const normalized_key& lhs, const normalized_key& rhs) {
+        return !(lhs == rhs);
+    }
+    friend bool operator< (const normalized_key& lhs, const normalized_key& rhs) {
+        return compare(lhs, rhs) < 0;
+    }
+    friend bool operator> (const normalized_key& lhs, const normalized_key& rhs) {
+        return compare(lhs, rhs) > 0;
+    }
+    friend bool operator<= (const normalized_key& lhs, const normalized_key& rhs) {
+        return compare(lhs, rhs) <= 0;
+    }
+    friend bool operator>= (const normalized_key& lhs, const normalized_key& rhs) {
+        return compare(lhs, rhs) >= 0;
+    }
+
+    template<typename Archiver>
+    void visit(Archiver& ar) {
+        ar & bytes_;
+    }
+
+private:
+    std::string bytes_;
+};
+
+/**
+ * @brief Encodes a key into an order preserving byte string and back
+ *
+ * Integers are written big endian (with the sign bit flipped for signed types), floating point numbers use the usual
+ * sign-magnitude flip and strings are escaped (0x00 becomes 0x00 0xFF) and terminated by 0x00 0x00 so that they can be
+ * followed by further components. Pairs and tuples are the concatenation of their components. -0.0 is encoded as 0.0
+ * and every NaN as the same positive quiet NaN, which sorts after infinity.
+ */
+template<typename T, typename Enable = void>
+struct key_encoder;
+
+template<typename T>
+struct key_encoder<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+    typedef typename std::make_unsigned<T>::type unsigned_type;
+    static constexpr unsigned_type sign_bit = std::is_signed<T>::value
+            ? unsigned_type(unsigned_type(1) << (sizeof(T) * 8 - 1)) : unsigned_type(0);
+
+    static void encode(std::string& out, T value) {
+        auto v = unsigned_type(unsigned_type(value) ^ sign_bit);
+        char buf[sizeof(T)];
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            buf[sizeof(T) - 1 - i] = char(uint8_t(v >> (i * 8)));
+        }
+        out.append(buf, sizeof(T));
+    }
+
+    static const char* decode(const char* pos, T& value) {
+        unsigned_type v = 0;
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            v = unsigned_type((v << 8) | uint8_t(pos[i]));
+        }
+        value = T(unsigned_type(v ^ sign_bit));
+        return pos + sizeof(T);
+    }
+};
+
+template<typename T>
+struct key_encoder<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    typedef typename std::conditional<sizeof(T) == sizeof(uint32_t), uint32_t, uint64_t>::type bits_type;
+    static_assert(sizeof(T) == sizeof(bits_type), "Unsupported floating point type");
+    static constexpr bits_type sign_bit = bits_type(1) << (sizeof(bits_type) * 8 - 1);
+
+    static void encode(std::string& out, T value) {
+        // -0.0 equals 0.0 and every NaN is the same key, so they get the same bytes
+        if (value == T(0)) {
+            value = T(0);
+        } else if (std::isnan(value)) {
+            value = std::copysign(std::numeric_limits<T>::quiet_NaN(), T(1));
+        }
+        bits_type bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        bits = (bits & sign_bit) ? bits_type(~bits) : bits_type(bits | sign_bit);
+        key_encoder<bits_type>::encode(out, bits);
+    }
+
+    static const char* decode(const char* pos, T& value) {
+        bits_type bits;
+        pos = key_encoder<bits_type>::decode(pos, bits);
+        bits = (bits & sign_bit) ? bits_type(bits & ~sign_bit) : bits_type(~bits);
+        std::memcpy(&value, &bits, sizeof(bits));
+        return pos;
+    }
+};
+
+template<>
+struct key_encoder<std::string> {
+    static void encode(std::string& out, const std::string& value) {
+        out.reserve(out.size() + value.size() + 2);
+        for (char c : value) {
+            out.push_back(c);
+            if (c == '\0') {
+                out.push_back('\xff');
+            }
+        }
+        out.push_back('\0');
+        out.push_back('\0');
+    }
+
+    static const char* decode(const char* pos, std::string& value) {
+        value.clear();
+        for (;;) {
+            if (*pos == '\0') {
+                if (pos[1] == '\0') {
+                    return pos + 2;
+                }
+                ++pos;
+                value.push_back('\0');
+            } else {
+                value.push_back(*pos);
+            }
+            ++pos;
+        }
+    }
+};
+
+template<typename T, typename U>
+struct key_encoder<std::pair<T, U>> {
+    static void encode(std::string& out, const std::pair<T, U>& value) {
+        key_encoder<T>::encode(out, value.first);
+        key_encoder<U>::encode(out, value.second);
+    }
+
+    static const char* decode(const char* pos, std::pair<T, U>& value) {
+        pos = key_encoder<T>::decode(pos, value.first);
+        return key_encoder<U>::decode(pos, value.second);
+    }
+};
+
+namespace detail {
+
+template<size_t Index, size_t Size>
+struct tuple_encoder {
+    template<typename Tuple>
+    static void encode(std::string& out, const Tuple& value) {
+        typedef typename std::tuple_element<Index, Tuple>::type element_type;
+        key_encoder<element_type>::encode(out, std::get<Index>(value));
+        tuple_encoder<Index + 1, Size>::encode(out, value);
+    }
+
+    template<typename Tuple>
+    static const char* decode(const char* pos, Tuple& value) {
+        typedef typename std::tuple_element<Index, Tuple>::type element_type;
+        pos = key_encoder<element_type>::decode(pos, std::get<Index>(value));
+        return tuple_encoder<Index + 1, Size>::decode(pos, value);
+    }
+};
+
+template<size_t Size>
+struct tuple_encoder<Size, Size> {
+    template<typename Tuple>
+    static void encode(std::string&, const Tuple&) {
+    }
+
+    template<typename Tuple>
+    static const char* decode(const char* pos, Tuple&) {
+        return pos;
+    }
+};
+
+} // namespace detail
+
+template<typename... T>
+struct key_encoder<std::tuple<T...>> {
+    static void encode(std::string& out, const std::tuple<T...>& value) {
+        detail::tuple_encoder<0, sizeof...(T)>::encode(out, value);
+    }
+
+    static const char* decode(const char* pos, std::tuple<T...>& value) {
+        return detail::tuple_encoder<0, sizeof...(T)>::decode(pos, value);
+    }
+};
+
+/**
+ * @brief Encodes the key into its normalized form
+ *
+ * This should be done once per operation, the resulting key is then used for all comparisons in the tree.
+ */
+template<typename T>
+normalized_key normalize(const T& key) {
+    std::string bytes;
+    key_encoder<T>::encode(bytes, key);
+    return normalized_key(std::move(bytes));
+}
+
+/**
+ * @brief Decodes a key previously encoded with normalize
+ */
+template<typename T>
+T denormalize(const normalized_key& key) {
+    T result;
+    key_encoder<T>::decode(key.data(), result);
+    return result;
+}
+
+} // namespace bdtree
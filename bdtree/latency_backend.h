@@ -0,0 +1,191 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <bdtree/decorated_backend.h>
+
+#include <crossbow/non_copyable.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+namespace bdtree {
+
+/**
+ * @brief Distribution of the latency added to a call, in nanoseconds
+ */
+class latency_distribution {
+public:
+    enum class kind : uint8_t {
+        constant,
+        uniform,
+        exponential,
+    };
+
+    // no latency
+    latency_distribution() = default;
+
+    static latency_distribution constant(uint64_t latency_ns) {
+        return latency_distribution(kind::constant, latency_ns, latency_ns);
+    }
+
+    // latencies evenly spread between min_ns and max_ns
+    static latency_distribution uniform(uint64_t min_ns, uint64_t max_ns) {
+        return latency_distribution(kind::uniform, min_ns, max_ns);
+    }
+
+    // at least min_ns with an exponentially distributed part on top, giving a long tail
+    static latency_distribution exponential(uint64_t min_ns, uint64_t mean_ns) {
+        return latency_distribution(kind::exponential, min_ns, mean_ns);
+    }
+
+    uint64_t sample(std::mt19937_64& random) const;
+
+private:
+    latency_distribution(kind k, uint64_t a, uint64_t b)
+            : kind_(k), a_(a), b_(b) {
+    }
+
+    kind kind_ = kind::constant;
+    uint64_t a_ = 0;
+    uint64_t b_ = 0;
+};
+
+struct latency_backend_config {
+    explicit latency_backend_config(latency_distribution latency = latency_distribution()) {
+        this->latency.fill(latency);
+    }
+
+    latency_distribution& operator[] (backend_call call) {
+        return latency[size_t(call)];
+    }
+
+    // latency of a round-trip of every call, half of it is spent before the call reaches the backend
+    std::array<latency_distribution, num_backend_calls> latency;
+
+    // bytes per second in each direction between the tree and the backend, 0 for no limit
+    uint64_t bandwidth = 0;
+
+    // delays up to this long are spent spinning, longer ones sleeping
+    uint64_t spin_threshold_ns = 50000;
+
+    // seed of the per-thread random generators, a thread takes it from the first backend it calls
+    uint64_t seed = 0;
+};
+
+/**
+ * @brief Counters of one kind of call, delay_ns is the time spent in added latency and transfers
+ */
+struct call_statistics {
+    uint64_t calls = 0;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+    uint64_t delay_ns = 0;
+    uint64_t total_ns = 0;
+};
+
+namespace detail {
+
+/**
+ * @brief Delays calls according to a latency_backend_config and counts them
+ *
+ * The two directions of the link are modeled separately: a transfer starts once the previous one in its direction is
+ * done and takes length / bandwidth.
+ */
+class latency_model : crossbow::non_copyable, crossbow::non_movable {
+public:
+    typedef std::chrono::steady_clock clock;
+
+    struct pending_call {
+        backend_call call;
+        clock::time_point start;
+        uint64_t latency_ns;
+        uint64_t delay_ns;
+    };
+
+    explicit latency_model(const latency_backend_config& config)
+            : config_(config) {
+    }
+
+    /**
+     * @brief Waits for the first half of the call's latency and for sending request_length bytes
+     */
+    pending_call begin(backend_call call, size_t request_length);
+
+    /**
+     * @brief Waits for the second half of the call's latency and for receiving the response, counts the call
+     */
+    void end(pending_call& pending, const backend_call_info& info);
+
+    call_statistics statistics(backend_call call) const;
+
+    void reset_statistics();
+
+private:
+    struct alignas(64) counters {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> errors{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> delay_ns{0};
+        std::atomic<uint64_t> total_ns{0};
+    };
+
+    // waits for latency_ns and the transfer of length bytes over link, returns the time waited
+    uint64_t delay(uint64_t latency_ns, size_t length, std::atomic<uint64_t>& link);
+
+    latency_backend_config config_;
+    alignas(64) std::atomic<uint64_t> to_backend_{0};
+    alignas(64) std::atomic<uint64_t> from_backend_{0};
+    std::array<counters, num_backend_calls> counters_;
+};
+
+} // namespace detail
+
+/**
+ * @brief Backend adding latency and bandwidth limits to the calls of another backend and counting them
+ *
+ * Makes a local backend behave like remote storage: every call waits for half of its sampled latency and the transfer
+ * of its request before it reaches the wrapped backend, and for the other half and the transfer of its response
+ * afterwards. Concurrent operations therefore race over the same windows as they would against a remote backend.
+ * The wrapped backend is constructed from the arguments following the config. Tx ids and get_remote_ptr are not
+ * delayed.
+ */
+template <typename Backend>
+class latency_backend : public decorated_backend<Backend, detail::latency_model> {
+public:
+    using decorated_backend<Backend, detail::latency_model>::decorated_backend;
+
+    call_statistics statistics(backend_call call) const {
+        return this->hook().statistics(call);
+    }
+
+    void reset_statistics() {
+        this->hook().reset_statistics();
+    }
+};
+
+} // namespace bdtree
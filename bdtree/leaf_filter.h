@@ -0,0 +1,214 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <bdtree/node_format.h>
+#include <bdtree/primitive_types.h>
+
+#include <boost/optional.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace bdtree {
+
+inline uint64_t mix_hash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * @brief 64 bit hash of a key, used by the leaf filters
+ */
+template<typename Key, typename Enable = void>
+struct key_hash {
+    uint64_t operator() (const Key& key) const {
+        return mix_hash(std::hash<Key>()(key));
+    }
+};
+
+template<typename Key>
+struct key_hash<Key, typename std::enable_if<byte_string_key<Key>::value>::type> {
+    uint64_t operator() (const Key& key) const {
+        auto data = reinterpret_cast<const uint8_t*>(byte_string_key<Key>::data(key));
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < byte_string_key<Key>::size(key); ++i) {
+            h = (h ^ data[i]) * 0x100000001b3ull;
+        }
+        return mix_hash(h);
+    }
+};
+
+/**
+ * @brief Bloom filter over the keys of one leaf, about 1% false positives
+ */
+class bloom_filter {
+public:
+    bloom_filter(size_t keys)
+            : bits_((std::max<size_t>(keys, 1) * bits_per_key + 63) / 64) {
+    }
+
+    void add(uint64_t hash) {
+        auto delta = (hash >> 33) | (hash << 31);
+        for (unsigned i = 0; i < probes; ++i) {
+            auto bit = hash % (bits_.size() * 64);
+            bits_[bit / 64] |= uint64_t(1) << (bit % 64);
+            hash += delta;
+        }
+    }
+
+    bool may_contain(uint64_t hash) const {
+        auto delta = (hash >> 33) | (hash << 31);
+        for (unsigned i = 0; i < probes; ++i) {
+            auto bit = hash % (bits_.size() * 64);
+            if (!(bits_[bit / 64] & (uint64_t(1) << (bit % 64)))) {
+                return false;
+            }
+            hash += delta;
+        }
+        return true;
+    }
+
+private:
+    static constexpr size_t bits_per_key = 10;
+    static constexpr unsigned probes = 7;
+
+    std::vector<uint64_t> bits_;
+};
+
+/**
+ * @brief Side table of the cache holding a bloom filter per leaf version
+ *
+ * A filter is only valid for the version of the logical pointer it was built from, every delta, split or merge
+ * installs a new version and thereby invalidates it. The table is direct mapped, a new filter replaces whatever
+ * filter occupied its slot. Filters are much smaller than the leaves, so the table covers leaves that have long been
+ * evicted from the node cache. The slots are allocated in chunks on the first filter that maps into them, a cache of
+ * a small tree only pays for the few chunks it uses.
+ */
+template<typename Key>
+class leaf_filter_table {
+public:
+    struct entry {
+        logical_pointer lptr;
+        uint64_t rc_version;
+        Key low_key;
+        boost::optional<Key> high_key;
+        bloom_filter filter;
+
+        entry(logical_pointer lptr, uint64_t rc_version, Key low_key, boost::optional<Key> high_key, size_t keys)
+                : lptr(lptr), rc_version(rc_version), low_key(std::move(low_key)), high_key(std::move(high_key)),
+                  filter(keys) {
+        }
+
+        bool covers(const Key& key) const {
+            return !(key < low_key) && (!high_key || key < *high_key);
+        }
+
+        bool may_contain(const Key& key) const {
+            return filter.may_contain(key_hash<Key>()(key));
+        }
+    };
+
+    leaf_filter_table(size_t capacity = 1 << 14)
+            : chunk_count_((std::max(capacity, size_t(1)) + chunk_size - 1) / chunk_size),
+              chunks_(new std::atomic<chunk*>[chunk_count_]()) {
+    }
+
+    ~leaf_filter_table() {
+        for (size_t i = 0; i < chunk_count_; ++i) {
+            delete chunks_[i].load();
+        }
+    }
+
+    leaf_filter_table(const leaf_filter_table&) = delete;
+    leaf_filter_table& operator= (const leaf_filter_table&) = delete;
+
+    std::shared_ptr<const entry> find(logical_pointer lptr, uint64_t rc_version) const {
+        auto s = slot(lptr);
+        auto c = chunks_[s / chunk_size].load(std::memory_order_acquire);
+        if (c == nullptr) {
+            return nullptr;
+        }
+        auto res = std::atomic_load(&c->slots[s % chunk_size]);
+        if (res && res->lptr == lptr && res->rc_version == rc_version) {
+            return res;
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Builds the filter for a resolved leaf unless the table already holds it
+     */
+    template<typename LeafNode>
+    void add(logical_pointer lptr, uint64_t rc_version, const LeafNode& leaf) {
+        if (find(lptr, rc_version)) {
+            return;
+        }
+        auto res = std::make_shared<entry>(lptr, rc_version, leaf.low_key_, leaf.high_key_, leaf.array_.size());
+        key_hash<Key> hash;
+        for (auto& e : leaf.array_) {
+            res->filter.add(hash(e.first));
+        }
+        auto s = slot(lptr);
+        auto& c = get_chunk(s / chunk_size);
+        std::atomic_store(&c.slots[s % chunk_size], std::shared_ptr<const entry>(std::move(res)));
+    }
+
+private:
+    static constexpr size_t chunk_size = 256;
+
+    struct chunk {
+        std::shared_ptr<const entry> slots[chunk_size];
+    };
+
+    size_t slot(logical_pointer lptr) const {
+        return mix_hash(lptr.value) % (chunk_count_ * chunk_size);
+    }
+
+    chunk& get_chunk(size_t i) {
+        auto c = chunks_[i].load(std::memory_order_acquire);
+        if (c == nullptr) {
+            auto allocated = new chunk();
+            if (chunks_[i].compare_exchange_strong(c, allocated, std::memory_order_acq_rel)) {
+                c = allocated;
+            } else {
+                delete allocated;
+            }
+        }
+        return *c;
+    }
+
+    size_t chunk_count_;
+    std::unique_ptr<std::atomic<chunk*>[]> chunks_;
+};
+
+} // namespace bdtree
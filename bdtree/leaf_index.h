@@ -0,0 +1,101 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <bdtree/leaf_filter.h>
+#include <bdtree/node_format.h>
+
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace bdtree {
+
+/**
+ * @brief Selects which leaves get a hash index for point lookups
+ *
+ * Enabled by default for the key types key_hash handles without std::hash support from the user. Leaves with fewer
+ * than min_entries entries are searched with a binary search, which is as fast for them.
+ */
+template<typename Key>
+struct leaf_index_traits {
+    static constexpr bool enabled = std::is_integral<Key>::value || byte_string_key<Key>::value;
+    static constexpr size_t min_entries = 64;
+};
+
+/**
+ * @brief Open addressing hash directory over the entries of a leaf
+ *
+ * Each slot holds the upper half of the key hash and the position of the entry plus one, so most probes for absent
+ * keys are answered without comparing keys. The index refers to the array of the leaf by position and is therefore
+ * only built for leaves that are not modified anymore, i.e. resolved leaves in the cache.
+ */
+template<typename Key>
+class leaf_hash_index {
+public:
+    template<typename Array>
+    explicit leaf_hash_index(const Array& array) {
+        size_t capacity = 16;
+        while (capacity < array.size() * 2) {
+            capacity *= 2;
+        }
+        mask_ = capacity - 1;
+        slots_.resize(capacity, 0);
+        key_hash<Key> hash;
+        for (size_t i = 0; i < array.size(); ++i) {
+            auto h = hash(array[i].first);
+            auto slot = h & mask_;
+            while (slots_[slot] != 0) {
+                slot = (slot + 1) & mask_;
+            }
+            slots_[slot] = (h & tag_mask) | uint64_t(i + 1);
+        }
+    }
+
+    // returns the position of key in array, or the size of array if it does not hold key
+    template<typename Array>
+    size_t find(const Array& array, const Key& key) const {
+        auto h = key_hash<Key>()(key);
+        auto tag = h & tag_mask;
+        for (auto slot = h & mask_; slots_[slot] != 0; slot = (slot + 1) & mask_) {
+            auto e = slots_[slot];
+            if ((e & tag_mask) == tag && array[(e & ~tag_mask) - 1].first == key) {
+                return size_t(e & ~tag_mask) - 1;
+            }
+        }
+        return array.size();
+    }
+
+    template<typename Array>
+    bool contains(const Array& array, const Key& key) const {
+        return find(array, key) != array.size();
+    }
+
+private:
+    static constexpr uint64_t tag_mask = 0xffffffff00000000ull;
+
+    uint64_t mask_;
+    std::vector<uint64_t> slots_;
+};
+
+} // namespace bdtree
@@ -28,6 +28,7 @@
 #include "search_operation.h"
 #include "split_operation.h"
 #include "merge_operation.h"
+#include "separated_value.h"
 
 namespace bdtree {
 
@@ -36,11 +37,12 @@ struct leaf_operation_base {
     bool consolidated = false;
 
     template <typename NodeTable>
-    void cleanup(NodeTable& node_table, const std::vector<physical_pointer>& ptrs) {
+    void cleanup(NodeTable& node_table, const std::vector<physical_pointer>& deltas, physical_pointer leaf_pptr) {
         if (!consolidated) return;
-        for (physical_pointer ptr : ptrs) {
+        for (physical_pointer ptr : deltas) {
             node_table.remove(ptr);
         }
+        node_table.remove(leaf_pptr);
     }
 };
 
@@ -54,12 +56,14 @@ struct insert_operation : public leaf_operation_base<Key, Value> {
         : key(key), value(value), comp(comp)
     {}
 
+    // uses the hash index only if readers built it, a leaf version is usually written only once
     bool has_conflicts(leaf_node<Key, Value>* leafp) {
-        return std::binary_search(leafp->array_.begin(), leafp->array_.end(), key, comp);
+        return leafp->has_key(key, false);
     }
 
-    std::vector<uint8_t> operator() (const node_pointer<Key, Value>* nptr, leaf_node<Key, Value>& ln, physical_pointer pptr) {
-        auto iter = std::lower_bound(ln.array_.begin(), ln.array_.end(), key, comp);
+    void operator() (const node_pointer<Key, Value>* nptr, leaf_node<Key, Value>& ln, physical_pointer pptr,
+            std::vector<uint8_t>& data) {
+        auto iter = key_lower_bound(ln.array_.begin(), ln.array_.end(), key, comp);
         //prevent the exact same entry from being inserted twice, just rewrite the same record
         if (iter == ln.array_.end()
                 || iter->second != value
@@ -72,14 +76,14 @@ struct insert_operation : public leaf_operation_base<Key, Value> {
             ln.deltas_.clear();
             ln.leaf_pptr_ = pptr;
             this->consolidated = true;
-            return ln.serialize();
+            ln.serialize_into(data);
         } else {
             this->consolidated = false;
             insert_delta<Key, Value> ins_delta;
             ins_delta.value = std::make_pair(key, value);
             ins_delta.next = nptr->ptr_;
             ln.deltas_.insert(ln.deltas_.begin(), pptr);
-            return ins_delta.serialize();
+            ins_delta.serialize_into(data);
         }
     }
 };
@@ -88,49 +92,60 @@ template<typename Key, typename Value, typename Compare = key_compare<Key, Value
 struct delete_operation : public leaf_operation_base<Key, Value> {
     const Key& key;
     Compare comp;
+    Value erased;
 
     delete_operation(const Key& key, Compare comp)
         : key(key), comp(comp)
     {}
 
     bool has_conflicts(leaf_node<Key, Value>* leafp) {
-        return !std::binary_search(leafp->array_.begin(), leafp->array_.end(), key, comp);
+        return !leafp->has_key(key, false);
     }
 
-    std::vector<uint8_t> operator() (const node_pointer<Key, Value>* nptr, leaf_node<Key, Value>& ln, physical_pointer pptr) {
-        auto iter = std::lower_bound(ln.array_.begin(), ln.array_.end(), key, comp);
+    void operator() (const node_pointer<Key, Value>* nptr, leaf_node<Key, Value>& ln, physical_pointer pptr,
+            std::vector<uint8_t>& data) {
+        auto iter = key_lower_bound(ln.array_.begin(), ln.array_.end(), key, comp);
         assert(iter->first == key);
+        if (value_storage<Value>::separates) {
+            erased = iter->second;
+        }
         ln.array_.erase(iter);
         auto leafp = nptr->as_leaf();
         if (leafp->deltas_.size() + 1 >= CONSOLIDATE_AT) {
             this->consolidated = true;
             ln.deltas_.clear();
             ln.leaf_pptr_ = pptr;
-            return ln.serialize();
+            ln.serialize_into(data);
         } else {
             this->consolidated = false;
             delete_delta<Key, Value> del_delta;
             del_delta.key = key;
             del_delta.next = nptr->ptr_;
             ln.deltas_.insert(ln.deltas_.begin(), pptr);
-            return del_delta.serialize();
+            del_delta.serialize_into(data);
         }
     }
+
+    template <typename NodeTable>
+    void cleanup(NodeTable& node_table, const std::vector<physical_pointer>& deltas, physical_pointer leaf_pptr) {
+        leaf_operation_base<Key, Value>::cleanup(node_table, deltas, leaf_pptr);
+        value_storage<Value>::release(erased, node_table);
+    }
 };
 
 template<typename Key, typename Value, typename Backend, typename Operation>
 bool exec_leaf_operation(const Key& key, Backend& backend, logical_table_cache<Key, Value, Backend>& cache, uint64_t tx_id,
-        Operation op) {
+        Operation op, finger<Key, Value, Backend>* f = nullptr) {
     // find the insert/erase candidate
-    auto leaf = lower_node_bound(key, backend, cache, tx_id);
+    auto leaf = lower_node_bound(key, backend, cache, tx_id, f);
     std::size_t nsize = leaf.first->as_leaf()->serialized_size();
     if (nsize >= MAX_NODE_SIZE) {
-        split_operation<Key, Value, Backend>::split(leaf.first, leaf.second);
-        return exec_leaf_operation(key, backend, cache, tx_id, op);
+        split_operation<Key, Value, Backend>::split(leaf.first, leaf.second, &key);
+        return exec_leaf_operation(key, backend, cache, tx_id, op, f);
     } else if (nsize < MIN_NODE_SIZE
                && !(leaf.first->as_leaf()->low_key_ == null_key<Key>::value() && !leaf.first->as_leaf()->high_key_)) {
         merge_operation<Key, Value, Backend>::merge(leaf.first, leaf.second);
-        return exec_leaf_operation(key, backend, cache, tx_id, op);
+        return exec_leaf_operation(key, backend, cache, tx_id, op, f);
     }
     auto context = std::move(leaf.second);
     auto& node_table = context.get_node_table();
@@ -142,13 +157,16 @@ bool exec_leaf_operation(const Key& key, Backend& backend, logical_table_cache<K
             return false;
         }
 
-        auto pptr = node_table.get_next_ptr();
+        auto pptr = node_table.next_ptr();
         std::unique_ptr<leaf_node<Key, Value>> lnptr(new leaf_node<Key, Value>(pptr));
+        // room for an inserted entry, so the copy is not reallocated by the operation
+        lnptr->array_.reserve(leafp->array_.size() + 1);
         *lnptr = *leafp;
 
         // create and get the serialized delta node or consolidated node
-        std::vector<uint8_t> data = op(leaf.first, *lnptr, pptr);
-        node_table.insert(pptr, reinterpret_cast<const char*>(data.data()), uint32_t(data.size()));
+        serialize_buffer data;
+        op(leaf.first, *lnptr, pptr, data.get());
+        node_table.insert(pptr, data.data(), data.size());
 
         // do the compare and swap
         std::error_code ec;
@@ -159,10 +177,8 @@ bool exec_leaf_operation(const Key& key, Backend& backend, logical_table_cache<K
             if (!cache.add_entry(nnp, tx_id)) {
                 delete nnp;
             }
-            std::vector<physical_pointer> ptrs = leafp->deltas_;
-            ptrs.push_back(leafp->leaf_pptr_);
             // do the cleanup if consolidated
-            op.cleanup(node_table, ptrs);
+            op.cleanup(node_table, leafp->deltas_, leafp->leaf_pptr_);
             return true;
         } else if (ec == error::object_doesnt_exist) {
             context.cache.invalidate(leaf.first->lptr_);
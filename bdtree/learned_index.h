@@ -0,0 +1,165 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <bdtree/primitive_types.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace bdtree {
+
+/**
+ * @brief Maps keys directly to the logical pointer of the leaf covering them
+ *
+ * Built from the entries of the inner nodes just above the leaves, i.e. from the low key of every leaf. For arithmetic
+ * keys the position of a key in that list is predicted by piecewise linear models with a bounded error, other keys
+ * are located with a binary search. The index is a snapshot: a leaf found through it has to be validated against its
+ * low and high key, the tree is searched from the root when the validation fails.
+ */
+template<typename Key>
+class learned_leaf_index {
+public:
+    typedef std::vector<std::pair<Key, logical_pointer>> entries_type;
+
+    /// Maximal distance between the predicted and the actual position of a leaf
+    static constexpr size_t max_error = 8;
+
+    learned_leaf_index(entries_type entries)
+            : entries_(std::move(entries)) {
+        build(std::is_arithmetic<Key>());
+    }
+
+    size_t size() const {
+        return entries_.size();
+    }
+
+    size_t segments() const {
+        return segments_.size();
+    }
+
+    /**
+     * @brief Returns the leaf whose low key is the last one smaller or equal to key, a zero pointer if there is none
+     */
+    logical_pointer find(const Key& key) const {
+        auto pos = find(key, std::is_arithmetic<Key>());
+        return pos == 0 ? logical_pointer{0} : entries_[pos - 1].second;
+    }
+
+    /**
+     * @brief Records a failed validation, returns true once the index mispredicted too often to be kept
+     */
+    bool mispredicted() const {
+        return ++misses_ > entries_.size() / 8 + 16;
+    }
+
+private:
+    struct segment {
+        Key first_key;
+        size_t start;
+        double slope;
+    };
+
+    // Returns the number of entries with a key smaller or equal to key
+    size_t upper_bound(const Key& key, size_t first, size_t last) const {
+        return size_t(std::upper_bound(entries_.begin() + first, entries_.begin() + last, key,
+                [](const Key& k, const std::pair<Key, logical_pointer>& e) {
+            return k < e.first;
+        }) - entries_.begin());
+    }
+
+    size_t find(const Key& key, std::false_type) const {
+        return upper_bound(key, 0, entries_.size());
+    }
+
+    size_t find(const Key& key, std::true_type) const {
+        auto seg = std::upper_bound(segments_.begin(), segments_.end(), key, [](const Key& k, const segment& s) {
+            return k < s.first_key;
+        });
+        if (seg == segments_.begin()) {
+            return 0;
+        }
+        --seg;
+        auto end = (seg + 1 == segments_.end() ? entries_.size() : (seg + 1)->start);
+        // clamped before the conversion, which is undefined for values out of the range of size_t
+        auto offset = seg->slope * (double(key) - double(seg->first_key));
+        auto length = double(end - seg->start);
+        auto predicted = seg->start + size_t(offset > 0.0 ? std::min(offset, length) : 0.0);
+        auto first = predicted > seg->start + max_error ? predicted - max_error : seg->start;
+        auto last = std::min(predicted + max_error + 2, end);
+        if (first >= last) {
+            return upper_bound(key, seg->start, end);
+        }
+        auto res = upper_bound(key, first, last);
+        if ((res == first && first != seg->start) || (res == last && last != end)) {
+            // outside of the error bound, which only happens through rounding
+            return upper_bound(key, seg->start, end);
+        }
+        return res;
+    }
+
+    void build(std::false_type) {
+    }
+
+    // greedy segmentation: extend a segment as long as one slope keeps every entry within max_error of its position
+    void build(std::true_type) {
+        size_t start = 0;
+        while (start < entries_.size()) {
+            auto origin = double(entries_[start].first);
+            double low = 0.0;
+            double high = std::numeric_limits<double>::infinity();
+            auto end = start + 1;
+            for (; end < entries_.size(); ++end) {
+                auto dx = double(entries_[end].first) - origin;
+                auto dy = double(end - start);
+                if (dx <= 0.0) {
+                    if (dy > max_error) {
+                        break;
+                    }
+                    continue;
+                }
+                auto new_low = std::max(low, (dy - max_error) / dx);
+                auto new_high = std::min(high, (dy + max_error) / dx);
+                if (new_low > new_high) {
+                    break;
+                }
+                low = new_low;
+                high = new_high;
+            }
+            double slope = (high == std::numeric_limits<double>::infinity() ? low : (low + high) / 2);
+            segments_.push_back(segment{entries_[start].first, start, slope});
+            start = end;
+        }
+    }
+
+    entries_type entries_;
+    std::vector<segment> segments_;
+    mutable std::atomic<size_t> misses_{0};
+};
+
+} // namespace bdtree
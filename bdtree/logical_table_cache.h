@@ -27,11 +27,15 @@
 #include <bdtree/base_types.h>
 #include <bdtree/acache.h>
 #include <bdtree/error_code.h>
+#include <bdtree/leaf_filter.h>
+#include <bdtree/learned_index.h>
+#include <bdtree/tx_id_source.h>
 
 #include <crossbow/allocator.hpp>
 
 #include <algorithm>
 #include <iostream>
+#include <memory>
 
 namespace bdtree {
     template<typename Key, typename Value, typename Backend>
@@ -50,7 +54,21 @@ namespace bdtree {
         logical_table_cache& operator= (logical_table_cache&&) = delete;
     private:
         cache<Key, Value> map_;
+        leaf_filter_table<Key> filters_;
+        std::shared_ptr<const learned_leaf_index<Key>> learned_index_;
     public:
+        leaf_filter_table<Key>& filters() {
+            return filters_;
+        }
+
+        std::shared_ptr<const learned_leaf_index<Key>> learned_index() const {
+            return std::atomic_load(&learned_index_);
+        }
+
+        void set_learned_index(std::shared_ptr<const learned_leaf_index<Key>> index) {
+            std::atomic_store(&learned_index_, std::move(index));
+        }
+
         node_pointer<Key, Value>* get_from_cache(logical_pointer lptr,
                 operation_context<Key, Value, Backend>& context) {
             auto tx_id = context.tx_id;
@@ -71,50 +89,66 @@ namespace bdtree {
 
         node_pointer<Key, Value>* get_without_cache(logical_pointer lptr,
                     operation_context<Key,Value, Backend>& context) {
-            bool resolve_succ = false;
-            node_pointer<Key, Value>* result;
-            while (!resolve_succ) {
-                auto txid = get_last_tx_id();
+            for (;;) {
+                auto txid = tx_id_source(context.backend).last();
                 auto& ptr_table = context.get_ptr_table();
                 std::error_code ec;
                 auto pptr = ptr_table.read(lptr, ec);
                 if (ec == error::object_doesnt_exist)
                     return nullptr;
                 assert(!ec);
-                auto np = new node_pointer<Key, Value>(lptr, std::get<0>(pptr), std::get<1>(pptr));
-                decltype(np) todel = nullptr;
-                map_.exec_on(lptr, [&np, txid, &todel](node_pointer<Key, Value>*& e){
-                    todel = nullptr;
-                    np->release_old();
-                    bool did_write = false;
-                    if (e == nullptr || e->rc_version_ < np->rc_version_) {
-                        np->reset_old(e);
-                        e = np;
-                        did_write = true;
-                    } else {
-                        todel = np;
-                        np = e;
-                    }
-                    for (;;) {
-                        auto lasttx = e->last_tx_id_.load();
-                        auto nlasttx = std::max(txid, lasttx);
-                        if (lasttx != nlasttx) {
-                            if (e->last_tx_id_.compare_exchange_strong(lasttx, nlasttx)) {
-                                return did_write ? cache_return::Write : cache_return::Read;
-                            }
-                        } else {
+                if (auto np = install(lptr, txid, pptr, context))
+                    return np;
+            }
+        }
+
+        /**
+         * @brief Like get_without_cache, but starts from a version of lptr the caller already read from the ptr table
+         *
+         * txid must have been taken from the tx id source before that read. The ptr table is only read again if that
+         * version cannot be resolved anymore.
+         */
+        node_pointer<Key, Value>* get_without_cache(logical_pointer lptr, uint64_t txid,
+                    const std::tuple<physical_pointer, uint64_t>& pptr, operation_context<Key,Value, Backend>& context) {
+            if (auto np = install(lptr, txid, pptr, context))
+                return np;
+            return get_without_cache(lptr, context);
+        }
+    private:
+        // puts the version of lptr read at txid into the cache unless it holds a newer one, returns the cached node
+        // or nullptr if it could not be resolved
+        node_pointer<Key, Value>* install(logical_pointer lptr, uint64_t txid,
+                    const std::tuple<physical_pointer, uint64_t>& pptr, operation_context<Key,Value, Backend>& context) {
+            auto np = new node_pointer<Key, Value>(lptr, std::get<0>(pptr), std::get<1>(pptr));
+            decltype(np) todel = nullptr;
+            map_.exec_on(lptr, [&np, txid, &todel](node_pointer<Key, Value>*& e){
+                todel = nullptr;
+                np->release_old();
+                bool did_write = false;
+                if (e == nullptr || e->rc_version_ < np->rc_version_) {
+                    np->reset_old(e);
+                    e = np;
+                    did_write = true;
+                } else {
+                    todel = np;
+                    np = e;
+                }
+                for (;;) {
+                    auto lasttx = e->last_tx_id_.load();
+                    auto nlasttx = std::max(txid, lasttx);
+                    if (lasttx != nlasttx) {
+                        if (e->last_tx_id_.compare_exchange_strong(lasttx, nlasttx)) {
                             return did_write ? cache_return::Write : cache_return::Read;
                         }
+                    } else {
+                        return did_write ? cache_return::Write : cache_return::Read;
                     }
-                });
-                if (todel) delete todel;
-                if (np->resolve(context)) {
-                    resolve_succ = true;
                 }
-                result = np;
-            }
-            return result;
+            });
+            if (todel) delete todel;
+            return np->resolve(context) ? np : nullptr;
         }
+    public:
 
         //returns true if node was successfully added to the cache
         bool add_entry(node_pointer<Key, Value>* node, uint64_t txid) {
@@ -0,0 +1,561 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <bdtree/base_backend.h>
+#include <bdtree/double_word_atomic.h>
+#include <bdtree/error_code.h>
+#include <bdtree/primitive_types.h>
+#include <bdtree/tx_id_source.h>
+
+#include <crossbow/allocator.hpp>
+#include <crossbow/non_copyable.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <tuple>
+#include <vector>
+
+namespace bdtree {
+
+/**
+ * @brief In-memory pointer table without locks
+ *
+ * Logical pointers are dense counters, so the table is an array indexed by the logical pointer. Each slot is a 128 bit
+ * atomic holding the physical pointer and its version: read is a single atomic load, insert, update and remove are a
+ * single compare and swap unless they race with another writer of the same slot. The array is split into segments of
+ * SegmentSize slots that are allocated when the first pointer in them is inserted and never moved, which bounds the
+ * table to MaxSegments * SegmentSize logical pointers.
+ */
+template<size_t SegmentSize = (1 << 16), size_t MaxSegments = (1 << 14)>
+class basic_memory_ptr_table : public base_ptr_table<basic_memory_ptr_table<SegmentSize, MaxSegments>> {
+public:
+    static constexpr uint64_t capacity = uint64_t(SegmentSize) * MaxSegments;
+
+    basic_memory_ptr_table()
+            : segments_(new std::atomic<segment*>[MaxSegments]) {
+        for (size_t i = 0; i < MaxSegments; ++i) {
+            segments_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~basic_memory_ptr_table() {
+        for (size_t i = 0; i < MaxSegments; ++i) {
+            delete segments_[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    basic_memory_ptr_table(const basic_memory_ptr_table&) = delete;
+    basic_memory_ptr_table& operator= (const basic_memory_ptr_table&) = delete;
+
+    logical_pointer get_next_ptr() {
+        return {counter_.fetch_add(1) + 1};
+    }
+
+    logical_pointer reserve_ptrs(uint64_t count) {
+        return {counter_.fetch_add(count) + 1};
+    }
+
+    logical_pointer get_remote_ptr() {
+        return {counter_.load()};
+    }
+
+    std::tuple<physical_pointer, uint64_t> read(logical_pointer lptr, std::error_code& ec) {
+        auto s = find_slot(lptr);
+        entry current = s ? s->load() : entry{};
+        if (current.version == 0) {
+            ec = make_error_code(error::object_doesnt_exist);
+            return std::make_tuple(physical_pointer{0}, uint64_t(0));
+        }
+        return std::make_tuple(physical_pointer{current.pptr}, current.version);
+    }
+
+    using base_ptr_table<basic_memory_ptr_table>::read;
+
+    uint64_t insert(logical_pointer lptr, physical_pointer pptr, std::error_code& ec) {
+        auto& s = slot(lptr);
+        entry expected{};
+        if (!s.cas(expected, entry{pptr.value, 1})) {
+            ec = make_error_code(error::object_exists);
+            return expected.version;
+        }
+        return 1;
+    }
+
+    using base_ptr_table<basic_memory_ptr_table>::insert;
+
+    uint64_t update(logical_pointer lptr, physical_pointer pptr, uint64_t version, std::error_code& ec) {
+        auto s = find_slot(lptr);
+        if (s == nullptr) {
+            ec = make_error_code(error::object_doesnt_exist);
+            return 0;
+        }
+        auto current = s->load();
+        for (;;) {
+            if (current.version == 0) {
+                ec = make_error_code(error::object_doesnt_exist);
+                return 0;
+            }
+            if (current.version > version) {
+                ec = make_error_code(error::wrong_version);
+                return current.version;
+            }
+            if (s->cas(current, entry{pptr.value, current.version + 1})) {
+                return current.version + 1;
+            }
+        }
+    }
+
+    using base_ptr_table<basic_memory_ptr_table>::update;
+
+    void remove(logical_pointer lptr, uint64_t version, std::error_code& ec) {
+        auto s = find_slot(lptr);
+        if (s == nullptr) {
+            ec = make_error_code(error::object_doesnt_exist);
+            return;
+        }
+        auto current = s->load();
+        for (;;) {
+            if (current.version == 0) {
+                ec = make_error_code(error::object_doesnt_exist);
+                return;
+            }
+            if (current.version > version) {
+                ec = make_error_code(error::wrong_version);
+                return;
+            }
+            if (s->cas(current, entry{})) {
+                return;
+            }
+        }
+    }
+
+    using base_ptr_table<basic_memory_ptr_table>::remove;
+
+    /**
+     * @brief Sets the entry of a logical pointer and moves the pointer counter past it
+     *
+     * For loading a persisted table before it is used by the tree, version 0 clears the entry.
+     */
+    void restore(logical_pointer lptr, physical_pointer pptr, uint64_t version) {
+        slot(lptr).store(version == 0 ? entry{} : entry{pptr.value, version});
+        auto current = counter_.load();
+        while (current < lptr.value && !counter_.compare_exchange_weak(current, lptr.value)) {
+        }
+    }
+
+private:
+    // version 0 marks an empty slot, inserted pointers start at version 1
+    struct entry {
+        uint64_t pptr = 0;
+        uint64_t version = 0;
+
+        entry() = default;
+        entry(uint64_t pptr, uint64_t version)
+                : pptr(pptr), version(version) {
+        }
+    };
+
+    struct segment {
+        double_word_atomic<entry> slots[SegmentSize];
+    };
+
+    double_word_atomic<entry>* find_slot(logical_pointer lptr) {
+        if (lptr.value >= capacity) {
+            return nullptr;
+        }
+        auto seg = segments_[lptr.value / SegmentSize].load(std::memory_order_acquire);
+        return seg ? &seg->slots[lptr.value % SegmentSize] : nullptr;
+    }
+
+    double_word_atomic<entry>& slot(logical_pointer lptr) {
+        if (lptr.value >= capacity) {
+            throw std::length_error("logical pointer exceeds the capacity of the pointer table");
+        }
+        auto& seg = segments_[lptr.value / SegmentSize];
+        auto res = seg.load(std::memory_order_acquire);
+        if (res == nullptr) {
+            std::unique_ptr<segment> created(new segment());
+            if (seg.compare_exchange_strong(res, created.get(), std::memory_order_acq_rel)) {
+                res = created.release();
+            }
+        }
+        return res->slots[lptr.value % SegmentSize];
+    }
+
+    std::unique_ptr<std::atomic<segment*>[]> segments_;
+    alignas(64) std::atomic<uint64_t> counter_{0};
+};
+
+typedef basic_memory_ptr_table<> memory_ptr_table;
+
+namespace detail {
+
+/**
+ * @brief Blocks of the memory node table, allocated from per size class slabs
+ *
+ * Blocks hold a header followed by the node. Size class c holds blocks of 64 << c bytes, nodes that do not fit into
+ * the largest class get a block of their own. Freed blocks go to the free list of their class, the slabs are only
+ * returned when the storage is destroyed.
+ */
+class memory_node_storage {
+public:
+    struct block {
+        uint64_t pptr;
+        uint32_t length;
+        uint8_t size_class;
+
+        char* data() {
+            return reinterpret_cast<char*>(this + 1);
+        }
+    };
+
+    static constexpr size_t num_classes = 15;
+    static constexpr uint8_t large_class = 0xff;
+    static constexpr size_t slab_size = 256 * 1024;
+
+    memory_node_storage() = default;
+    memory_node_storage(const memory_node_storage&) = delete;
+    memory_node_storage& operator= (const memory_node_storage&) = delete;
+
+    block* allocate(size_t length) {
+        auto size = sizeof(block) + length;
+        uint8_t c = 0;
+        while (c < num_classes && (size_t(64) << c) < size) {
+            ++c;
+        }
+        block* res;
+        if (c == num_classes) {
+            res = reinterpret_cast<block*>(new char[size]);
+            c = large_class;
+        } else {
+            res = pop(c);
+        }
+        res->length = uint32_t(length);
+        res->size_class = c;
+        return res;
+    }
+
+    void release(block* b) {
+        if (b->size_class == large_class) {
+            delete[] reinterpret_cast<char*>(b);
+            return;
+        }
+        auto& cls = classes_[b->size_class];
+        std::lock_guard<std::mutex> _(cls.mutex);
+        cls.free.push_back(b);
+    }
+
+    /**
+     * @brief Returns a physical pointer whose slot was freed, 0 if there is none
+     */
+    uint64_t reuse_pptr() {
+        std::lock_guard<std::mutex> _(pptr_mutex_);
+        if (free_pptrs_.empty()) {
+            return 0;
+        }
+        auto res = free_pptrs_.back();
+        free_pptrs_.pop_back();
+        return res;
+    }
+
+    void recycle_pptr(uint64_t pptr) {
+        std::lock_guard<std::mutex> _(pptr_mutex_);
+        free_pptrs_.push_back(pptr);
+    }
+
+private:
+    struct size_class {
+        std::mutex mutex;
+        std::vector<block*> free;
+        std::vector<std::unique_ptr<char[]>> slabs;
+    };
+
+    block* pop(uint8_t c) {
+        auto& cls = classes_[c];
+        std::lock_guard<std::mutex> _(cls.mutex);
+        if (cls.free.empty()) {
+            auto block_size = size_t(64) << c;
+            auto count = std::max<size_t>(slab_size / block_size, 1);
+            cls.slabs.emplace_back(new char[block_size * count]);
+            auto slab = cls.slabs.back().get();
+            for (size_t i = count; i > 0; --i) {
+                cls.free.push_back(reinterpret_cast<block*>(slab + (i - 1) * block_size));
+            }
+        }
+        auto res = cls.free.back();
+        cls.free.pop_back();
+        return res;
+    }
+
+    std::array<size_class, num_classes> classes_;
+    std::mutex pptr_mutex_;
+    std::vector<uint64_t> free_pptrs_;
+};
+
+} // namespace detail
+
+/**
+ * @brief Result of a read from the memory node table
+ *
+ * Points into the block of the node. Removed blocks are only reused once every thread that was inside a
+ * crossbow::allocator scope at the time of the removal has left it, so the data stays valid until the reading thread
+ * leaves its current scope. The data is not shared beyond that, nodes decoded from it copy what they keep.
+ */
+class memory_node_data {
+public:
+    memory_node_data() = default;
+
+    memory_node_data(const char* data, size_t length)
+            : data_(data), length_(length) {
+    }
+
+    const char* data() const {
+        return data_;
+    }
+
+    size_t length() const {
+        return length_;
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t length_ = 0;
+};
+
+/**
+ * @brief In-memory node table storing the nodes in slabs
+ *
+ * The blocks are found through a segmented array indexed by the lower 40 bits of the physical pointer, reads are a
+ * single atomic load. The slot of a removed node is reused by get_next_ptr once the removal is safe, with the upper 24
+ * bits of the pointer counting the reuses: a stale physical pointer held by the cache never names a newer node. This
+ * also means get_remote_ptr only bounds the pointers that were never reused. The table does not lease pointers
+ * (reserve_ptrs), the tree would then never take the reused slots.
+ */
+template<size_t SegmentSize = (1 << 16), size_t MaxSegments = (1 << 14)>
+class basic_memory_node_table : public base_node_table<basic_memory_node_table<SegmentSize, MaxSegments>,
+        memory_node_data> {
+    typedef detail::memory_node_storage::block block;
+    typedef base_node_table<basic_memory_node_table<SegmentSize, MaxSegments>, memory_node_data> base;
+
+public:
+    static constexpr uint64_t capacity = uint64_t(SegmentSize) * MaxSegments;
+    static constexpr unsigned index_bits = 40;
+    static_assert(capacity <= (uint64_t(1) << index_bits), "Capacity exceeds the index bits of a physical pointer");
+
+    basic_memory_node_table()
+            : storage_(std::make_shared<detail::memory_node_storage>()),
+              segments_(new std::atomic<std::atomic<block*>*>[MaxSegments]) {
+        for (size_t i = 0; i < MaxSegments; ++i) {
+            segments_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~basic_memory_node_table() {
+        for (size_t i = 0; i < MaxSegments; ++i) {
+            auto seg = segments_[i].load(std::memory_order_relaxed);
+            if (seg == nullptr) {
+                continue;
+            }
+            for (size_t j = 0; j < SegmentSize; ++j) {
+                auto b = seg[j].load(std::memory_order_relaxed);
+                if (b != nullptr) {
+                    storage_->release(b);
+                }
+            }
+            delete[] seg;
+        }
+    }
+
+    basic_memory_node_table(const basic_memory_node_table&) = delete;
+    basic_memory_node_table& operator= (const basic_memory_node_table&) = delete;
+
+    physical_pointer get_next_ptr() {
+        auto res = storage_->reuse_pptr();
+        if (res != 0) {
+            return {res};
+        }
+        return {counter_.fetch_add(1) + 1};
+    }
+
+    physical_pointer get_remote_ptr() {
+        return {counter_.load()};
+    }
+
+    memory_node_data read(physical_pointer pptr, std::error_code& ec) {
+        auto s = find_slot(pptr);
+        auto b = s ? s->load(std::memory_order_acquire) : nullptr;
+        if (b == nullptr || b->pptr != pptr.value) {
+            ec = make_error_code(error::object_doesnt_exist);
+            return memory_node_data();
+        }
+        return memory_node_data(b->data(), b->length);
+    }
+
+    using base::read;
+
+    void insert(physical_pointer pptr, const char* data, size_t length, std::error_code& ec) {
+        auto& s = slot(pptr);
+        auto b = storage_->allocate(length);
+        b->pptr = pptr.value;
+        std::memcpy(b->data(), data, length);
+        block* expected = nullptr;
+        if (!s.compare_exchange_strong(expected, b, std::memory_order_release, std::memory_order_relaxed)) {
+            storage_->release(b);
+            ec = make_error_code(error::object_exists);
+        }
+    }
+
+    using base::insert;
+
+    void remove(physical_pointer pptr, std::error_code& ec) {
+        auto s = find_slot(pptr);
+        auto b = s ? s->load(std::memory_order_acquire) : nullptr;
+        if (b == nullptr || b->pptr != pptr.value || !s->compare_exchange_strong(b, nullptr)) {
+            ec = make_error_code(error::object_doesnt_exist);
+            return;
+        }
+        crossbow::allocator::destroy(new retired_block(storage_, b));
+    }
+
+    using base::remove;
+
+private:
+    // Returns the block and the slot to the storage once no reader can see them anymore
+    struct retired_block {
+        std::shared_ptr<detail::memory_node_storage> storage;
+        block* b;
+
+        retired_block(std::shared_ptr<detail::memory_node_storage> storage, block* b)
+                : storage(std::move(storage)), b(b) {
+        }
+
+        ~retired_block() {
+            auto pptr = b->pptr;
+            storage->release(b);
+            // the slot is retired for good once the reuse counter in the upper bits is exhausted
+            if ((pptr >> index_bits) != (uint64_t(1) << (64 - index_bits)) - 1) {
+                storage->recycle_pptr(pptr + (uint64_t(1) << index_bits));
+            }
+        }
+
+        void* operator new(std::size_t size) {
+            return crossbow::allocator::malloc(size);
+        }
+
+        void operator delete(void* ptr) {
+            crossbow::allocator::free_now(ptr);
+        }
+    };
+
+    std::atomic<block*>* find_slot(physical_pointer pptr) {
+        auto index = pptr.value & ((uint64_t(1) << index_bits) - 1);
+        if (index >= capacity) {
+            return nullptr;
+        }
+        auto seg = segments_[index / SegmentSize].load(std::memory_order_acquire);
+        return seg ? &seg[index % SegmentSize] : nullptr;
+    }
+
+    std::atomic<block*>& slot(physical_pointer pptr) {
+        auto index = pptr.value & ((uint64_t(1) << index_bits) - 1);
+        if (index >= capacity) {
+            throw std::length_error("physical pointer exceeds the capacity of the node table");
+        }
+        auto& seg = segments_[index / SegmentSize];
+        auto res = seg.load(std::memory_order_acquire);
+        if (res == nullptr) {
+            std::unique_ptr<std::atomic<block*>[]> created(new std::atomic<block*>[SegmentSize]);
+            for (size_t i = 0; i < SegmentSize; ++i) {
+                created[i].store(nullptr, std::memory_order_relaxed);
+            }
+            if (seg.compare_exchange_strong(res, created.get(), std::memory_order_acq_rel)) {
+                res = created.release();
+            }
+        }
+        return res[index % SegmentSize];
+    }
+
+    std::shared_ptr<detail::memory_node_storage> storage_;
+    std::unique_ptr<std::atomic<std::atomic<block*>*>[]> segments_;
+    alignas(64) std::atomic<uint64_t> counter_{0};
+};
+
+typedef basic_memory_node_table<> memory_node_table;
+
+namespace detail {
+
+template <typename TxIdSource>
+class memory_backend_tx_ids {
+public:
+    TxIdSource& get_tx_id_source() {
+        return tx_ids_;
+    }
+
+private:
+    TxIdSource tx_ids_;
+};
+
+// the process-wide default source is used through tx_id_source() of backends without their own
+template <>
+class memory_backend_tx_ids<global_tx_id_source> {
+};
+
+} // namespace detail
+
+/**
+ * @brief Backend keeping the pointer and the node table in memory
+ *
+ * Tx ids come from the process-wide default source. With TxIdSource = clock_tx_id_source the backend has a source of
+ * its own; map handles on it then have to draw their ids through next_tx_id(backend).
+ */
+template <typename TxIdSource = global_tx_id_source>
+class basic_memory_backend : public detail::memory_backend_tx_ids<TxIdSource>,
+        crossbow::non_copyable, crossbow::non_movable {
+public:
+    using ptr_table = memory_ptr_table;
+
+    using node_table = memory_node_table;
+
+    ptr_table& get_ptr_table() {
+        return ptr_;
+    }
+
+    node_table& get_node_table() {
+        return node_;
+    }
+
+private:
+    memory_ptr_table ptr_;
+    memory_node_table node_;
+};
+
+typedef basic_memory_backend<> memory_backend;
+
+} // namespace bdtree
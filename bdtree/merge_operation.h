@@ -22,8 +22,6 @@
  */
 #pragma once
 
-#include <stack>
-
 #include "base_types.h"
 #include "primitive_types.h"
 #include "util.h"
@@ -70,17 +68,19 @@ private:
     template<typename NodeType>
     static void consolidate(NodeType* left, NodeType* right, logical_pointer merge_lptr, physical_pointer merge_pptr, uint64_t merge_rc_version, merge_delta<Key, Value> *mergedelta, context_t& context) {
         auto& node_table = context.get_node_table();
-        auto pptr = node_table.get_next_ptr();
+        auto pptr = node_table.next_ptr();
 
         NodeType* consolidated = new NodeType(*left);
+        right->load_values();
         consolidated->array_.reserve(consolidated->array_.size() + right->array_.size());
         consolidated->array_.insert(consolidated->array_.end(), right->array_.begin(), right->array_.end());
         consolidated->right_link_ = right->right_link_;
         consolidated->high_key_ = right->high_key_;
         consolidated->clear_deltas();
         consolidated->set_pptr(pptr);
-        std::vector<uint8_t> data = consolidated->serialize();
-        node_table.insert(pptr, reinterpret_cast<const char*>(data.data()), uint32_t(data.size()));
+        serialize_buffer data;
+        consolidated->serialize_into(data.get());
+        node_table.insert(pptr, data.data(), data.size());
 
         auto& ptr_table = context.get_ptr_table();
         std::error_code ec;
@@ -115,7 +115,7 @@ private:
             return;
         }
         assert(!ec);
-        auto n = deserialize<Key, Value>(reinterpret_cast<const uint8_t*>(buf.data()), buf.length(), mergedelta->next);
+        auto n = deserialize<Key, Value>(buf, mergedelta->next);
         resolve_operation<Key, Value, Backend> op(merge_lptr, mergedelta->next, nullptr, context, merge_rc_version);
         if (!n->accept(op)) {
             return;
@@ -125,7 +125,7 @@ private:
             return;
         }
         assert(!ec);
-        n = deserialize<Key, Value>(reinterpret_cast<const uint8_t*>(buf.data()), buf.length(), mergedelta->rm_next);
+        n = deserialize<Key, Value>(buf, mergedelta->rm_next);
         resolve_operation<Key, Value, Backend> op2(mergedelta->rmdelta, mergedelta->rm_next, nullptr, context, merge_rc_version);
         if (!n->accept(op2)) {
             return;
@@ -200,10 +200,11 @@ public:
                     inner_node<Key, Value> newinner(*inner);
                     auto rm_offset = iter - inner->array_.begin();
                     newinner.array_.erase(newinner.array_.begin() + rm_offset);
-                    std::vector<uint8_t> data = newinner.serialize();
+                    serialize_buffer data;
+                    newinner.serialize_into(data.get());
 
-                    auto pptr = node_table.get_next_ptr();
-                    node_table.insert(pptr, reinterpret_cast<const char*>(data.data()), uint32_t(data.size()));
+                    auto pptr = node_table.next_ptr();
+                    node_table.insert(pptr, data.data(), data.size());
 
                     uint64_t rc_version;
                     std::error_code ec;
@@ -216,10 +217,11 @@ public:
                         rm_delta.next = pptr;
                         rm_delta.low_key = newinner.low_key_;
                         rm_delta.level = newinner.level;
-                        auto data = rm_delta.serialize();
+                        serialize_buffer data;
+                        rm_delta.serialize_into(data.get());
 
-                        auto rm_pptr = node_table.get_next_ptr();
-                        node_table.insert(rm_pptr, reinterpret_cast<const char*>(data.data()), uint32_t(data.size()));
+                        auto rm_pptr = node_table.next_ptr();
+                        node_table.insert(rm_pptr, data.data(), data.size());
 
                         rc_version = ptr_table.update(parent->lptr_, rm_pptr, parent->rc_version_, ec);
                         if (ec) {
@@ -262,14 +264,14 @@ public:
         merge.rm_next = rmdelta->next;
         merge.rmdeltapptr = removedelta_pptr;
         merge.level = rmdelta->level;
-        std::vector<uint8_t> data;
+        serialize_buffer data;
         auto& node_table = context.get_node_table();
         auto& ptr_table = context.get_ptr_table();
         for (;;) {
-            auto merge_pptr = node_table.get_next_ptr();
+            auto merge_pptr = node_table.next_ptr();
             merge.next = leftp->ptr_;
-            data = merge.serialize();
-            node_table.insert(merge_pptr, reinterpret_cast<const char*>(data.data()), uint32_t(data.size()));
+            merge.serialize_into(data.get());
+            node_table.insert(merge_pptr, data.data(), data.size());
 
             std::error_code ec;
             auto merge_rc_version = ptr_table.update(leftp->lptr_, merge_pptr, leftp->rc_version_, ec);
@@ -319,11 +321,12 @@ public:
         rmdelta.low_key = to_merge->low_key_;
         rmdelta.next = nodep->ptr_;
         rmdelta.level = to_merge->level;
-        std::vector<uint8_t> data = rmdelta.serialize();
+        serialize_buffer data;
+        rmdelta.serialize_into(data.get());
 
         auto& node_table = context.get_node_table();
-        auto pptr = node_table.get_next_ptr();
-        node_table.insert(pptr, reinterpret_cast<const char*>(data.data()), uint32_t(data.size()));
+        auto pptr = node_table.next_ptr();
+        node_table.insert(pptr, data.data(), data.size());
 
         auto& ptr_table = context.get_ptr_table();
         std::error_code ec;
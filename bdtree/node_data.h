@@ -0,0 +1,90 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace bdtree {
+
+/**
+ * @brief Read-only, reference counted view of a node returned by a node table
+ *
+ * Copying the view only copies the reference. The memory stays valid and unchanged as long as any copy, or any owner
+ * obtained through owner(), is alive, so nodes decoded from it may keep pointing into it instead of copying.
+ */
+class shared_node_data {
+public:
+    shared_node_data() = default;
+
+    shared_node_data(std::shared_ptr<const char> data, size_t length)
+            : data_(std::move(data)), length_(length) {
+    }
+
+    explicit shared_node_data(std::shared_ptr<const std::vector<char>> data)
+            : data_(data, data ? data->data() : nullptr), length_(data ? data->size() : 0) {
+    }
+
+    const char* data() const {
+        return data_.get();
+    }
+
+    size_t length() const {
+        return length_;
+    }
+
+    std::shared_ptr<const void> owner() const {
+        return data_;
+    }
+
+private:
+    std::shared_ptr<const char> data_;
+    size_t length_ = 0;
+};
+
+namespace detail {
+
+template<typename DataType>
+auto node_data_owner(const DataType& data, int) -> decltype(std::shared_ptr<const void>(data.owner())) {
+    return data.owner();
+}
+
+template<typename DataType>
+std::shared_ptr<const void> node_data_owner(const DataType&, long) {
+    return nullptr;
+}
+
+} // namespace detail
+
+/**
+ * @brief Returns the owner of the memory of a read result, null if the backend does not share it
+ */
+template<typename DataType>
+std::shared_ptr<const void> node_data_owner(const DataType& data) {
+    return detail::node_data_owner(data, 0);
+}
+
+} // namespace bdtree
@@ -0,0 +1,708 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <bdtree/key_encoding.h>
+#include <bdtree/primitive_types.h>
+
+#include <crossbow/Serializer.hpp>
+
+#include <boost/optional.hpp>
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace bdtree {
+
+/**
+ * @brief Layout flags stored in the upper bits of the node type byte
+ *
+ * The lower bits of the first byte of a serialized node hold the node_type_t, the upper bits describe the layout the
+ * node was written with. A node without any flag set is written with the crossbow archiver through the visit
+ * functions. Readers always decode every layout, so the layout written for a tree can be changed without rewriting
+ * existing nodes.
+ */
+namespace node_format {
+
+constexpr uint8_t type_mask = 0x0f;
+
+constexpr uint8_t plain = 0x00;
+
+/// Keys of inner and leaf nodes share a common prefix which is stored only once
+constexpr uint8_t prefix_keys = 0x10;
+
+/// Integer keys are stored as the smallest key of the node followed by bit-packed differences to that key
+constexpr uint8_t packed_keys = 0x20;
+
+/// Logical and physical pointers are written as varints, pointers of inner node entries as differences to the
+/// pointer of the previous entry
+constexpr uint8_t compact_pointers = 0x40;
+
+/// Leaf values are stored in a block of their own after the keys, so that the keys can be read without decoding any
+/// value
+constexpr uint8_t split_values = 0x80;
+
+constexpr uint8_t key_flags = prefix_keys | packed_keys;
+
+constexpr uint8_t flags_mask = prefix_keys | packed_keys | compact_pointers | split_values;
+
+/// Layout used by trees that do not specialize node_format_traits
+constexpr uint8_t defaults = compact_pointers;
+
+} // namespace node_format
+
+/**
+ * @brief Selects the layout in which the nodes of a tree are written
+ *
+ * Specialize this template for a key/value combination to select a different layout for that tree. By default
+ * all pointers are written as varints and byte string keys are written prefix compressed. Integer keys can be written
+ * bit-packed by selecting node_format::packed_keys, flags not applicable to the key type are ignored. Trees with large
+ * values should select node_format::split_values, leaves read from the node table then decode their values only when
+ * they are first accessed.
+ */
+template<typename Key, typename Value>
+struct node_format_traits {
+    static constexpr uint8_t flags = node_format::defaults;
+};
+
+template<typename Value>
+struct node_format_traits<std::string, Value> {
+    static constexpr uint8_t flags = node_format::defaults | node_format::prefix_keys;
+};
+
+template<typename Value>
+struct node_format_traits<normalized_key, Value> {
+    static constexpr uint8_t flags = node_format::defaults | node_format::prefix_keys;
+};
+
+/**
+ * @brief Access to the bytes of keys that can be prefix compressed
+ */
+template<typename Key>
+struct byte_string_key {
+    static constexpr bool value = false;
+};
+
+template<>
+struct byte_string_key<std::string> {
+    static constexpr bool value = true;
+    static const char* data(const std::string& key) {
+        return key.data();
+    }
+    static size_t size(const std::string& key) {
+        return key.size();
+    }
+    static std::string make(std::string bytes) {
+        return bytes;
+    }
+};
+
+template<>
+struct byte_string_key<normalized_key> {
+    static constexpr bool value = true;
+    static const char* data(const normalized_key& key) {
+        return key.data();
+    }
+    static size_t size(const normalized_key& key) {
+        return key.size();
+    }
+    static normalized_key make(std::string bytes) {
+        return normalized_key(std::move(bytes));
+    }
+};
+
+/**
+ * @brief Layout flags applicable to a key type
+ */
+template<typename Key>
+struct key_formats {
+    static constexpr uint8_t supported = (byte_string_key<Key>::value ? node_format::prefix_keys : node_format::plain)
+            | (std::is_integral<Key>::value ? node_format::packed_keys : node_format::plain);
+};
+
+/**
+ * @brief Counts the bytes a node would occupy in a given layout
+ */
+class wire_sizer {
+public:
+    void put_u8(uint8_t) {
+        ++size;
+    }
+
+    void put_varint(uint64_t value) {
+        do {
+            ++size;
+            value >>= 7;
+        } while (value != 0);
+    }
+
+    void put_bytes(const void*, size_t length) {
+        size += length;
+    }
+
+    template<typename T>
+    void put(const T& obj) {
+        put_object(obj, std::is_trivially_copyable<T>());
+    }
+
+    size_t size = 0;
+
+private:
+    template<typename T>
+    void put_object(const T&, std::true_type) {
+        size += sizeof(T);
+    }
+
+    template<typename T>
+    void put_object(const T& obj, std::false_type) {
+        crossbow::sizer s;
+        s & obj;
+        put_varint(s.size);
+        size += s.size;
+    }
+};
+
+/**
+ * @brief Appends a node in a given layout to a byte buffer
+ *
+ * Trivially copyable objects are copied verbatim, all other objects are written with crossbow and prefixed by their
+ * length.
+ */
+class wire_writer {
+public:
+    wire_writer(std::vector<uint8_t>& buffer)
+            : buffer_(buffer) {
+    }
+
+    void put_u8(uint8_t value) {
+        buffer_.push_back(value);
+    }
+
+    void put_varint(uint64_t value) {
+        while (value >= 0x80) {
+            buffer_.push_back(uint8_t(value | 0x80));
+            value >>= 7;
+        }
+        buffer_.push_back(uint8_t(value));
+    }
+
+    void put_bytes(const void* data, size_t length) {
+        auto pos = buffer_.size();
+        buffer_.resize(pos + length);
+        if (length != 0) {
+            std::memcpy(buffer_.data() + pos, data, length);
+        }
+    }
+
+    template<typename T>
+    void put(const T& obj) {
+        put_object(obj, std::is_trivially_copyable<T>());
+    }
+
+private:
+    template<typename T>
+    void put_object(const T& obj, std::true_type) {
+        put_bytes(&obj, sizeof(T));
+    }
+
+    template<typename T>
+    void put_object(const T& obj, std::false_type) {
+        crossbow::sizer s;
+        s & obj;
+        put_varint(s.size);
+        auto pos = buffer_.size();
+        buffer_.resize(pos + s.size);
+        crossbow::serializer_into_array ser(buffer_.data() + pos);
+        ser & obj;
+    }
+
+    std::vector<uint8_t>& buffer_;
+};
+
+/**
+ * @brief Reads a node written by wire_writer
+ */
+class wire_reader {
+public:
+    wire_reader(const uint8_t* pos, std::shared_ptr<const void> owner = nullptr)
+            : pos_(pos), owner_(std::move(owner)) {
+    }
+
+    uint8_t get_u8() {
+        return *pos_++;
+    }
+
+    uint64_t get_varint() {
+        uint64_t value = 0;
+        unsigned shift = 0;
+        for (;;) {
+            uint8_t b = *pos_++;
+            value |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                return value;
+            }
+            shift += 7;
+        }
+    }
+
+    const uint8_t* get_bytes(size_t length) {
+        auto res = pos_;
+        pos_ += length;
+        return res;
+    }
+
+    template<typename T>
+    void get(T& obj) {
+        get_object(obj, std::is_trivially_copyable<T>());
+    }
+
+    const uint8_t* position() const {
+        return pos_;
+    }
+
+    /// Owner of the buffer being read, null if the bytes are only valid during decoding
+    const std::shared_ptr<const void>& owner() const {
+        return owner_;
+    }
+
+private:
+    template<typename T>
+    void get_object(T& obj, std::true_type) {
+        std::memcpy(&obj, pos_, sizeof(T));
+        pos_ += sizeof(T);
+    }
+
+    template<typename T>
+    void get_object(T& obj, std::false_type) {
+        auto length = get_varint();
+        crossbow::deserialize(obj, pos_);
+        pos_ += length;
+    }
+
+    const uint8_t* pos_;
+    std::shared_ptr<const void> owner_;
+};
+
+/**
+ * @brief Writes and reads the keys of a node array
+ *
+ * The generic version writes every key on its own. Byte string keys are written as one common prefix followed by the
+ * remaining suffix of each key when the node is written with node_format::prefix_keys.
+ */
+template<typename Key, bool ByteString = byte_string_key<Key>::value>
+struct key_array_codec {
+    template<typename Writer, typename Array>
+    static void encode_prefix(Writer&, const Array&, uint8_t) {
+    }
+
+    template<typename Writer>
+    static void encode_key(Writer& w, const Key& key) {
+        w.put(key);
+    }
+
+    static void decode_prefix(wire_reader&, uint8_t) {
+    }
+
+    static void decode_key(wire_reader& r, Key& key) {
+        r.get(key);
+    }
+};
+
+template<typename Key>
+struct key_array_codec<Key, true> {
+    typedef byte_string_key<Key> bytes;
+
+    size_t prefix_length = 0;
+    std::string prefix;
+
+    template<typename Writer, typename Array>
+    void encode_prefix(Writer& w, const Array& array, uint8_t flags) {
+        prefix_length = 0;
+        if ((flags & node_format::prefix_keys) && !array.empty()) {
+            auto first = bytes::data(array.front().first);
+            prefix_length = bytes::size(array.front().first);
+            for (auto& entry : array) {
+                auto key = bytes::data(entry.first);
+                auto length = std::min(prefix_length, bytes::size(entry.first));
+                size_t i = 0;
+                while (i < length && key[i] == first[i]) {
+                    ++i;
+                }
+                prefix_length = i;
+                if (prefix_length == 0) {
+                    break;
+                }
+            }
+            w.put_varint(prefix_length);
+            w.put_bytes(first, prefix_length);
+        } else if (flags & node_format::prefix_keys) {
+            w.put_varint(0);
+        }
+    }
+
+    template<typename Writer>
+    void encode_key(Writer& w, const Key& key) {
+        assert(bytes::size(key) >= prefix_length);
+        auto length = bytes::size(key) - prefix_length;
+        w.put_varint(length);
+        w.put_bytes(bytes::data(key) + prefix_length, length);
+    }
+
+    void decode_prefix(wire_reader& r, uint8_t flags) {
+        prefix.clear();
+        if (flags & node_format::prefix_keys) {
+            auto length = r.get_varint();
+            prefix.assign(reinterpret_cast<const char*>(r.get_bytes(length)), length);
+        }
+    }
+
+    void decode_key(wire_reader& r, Key& key) {
+        auto length = r.get_varint();
+        std::string k;
+        k.reserve(prefix.size() + length);
+        k.append(prefix);
+        k.append(reinterpret_cast<const char*>(r.get_bytes(length)), length);
+        key = bytes::make(std::move(k));
+    }
+};
+
+/**
+ * @brief Writes and reads the keys of a node array as a frame of reference block
+ *
+ * The keys of a node are sorted, so the block consists of the first key followed by the differences of all keys to
+ * the first key, packed with the number of bits needed for the largest difference. Encoding writes every 64 bit word
+ * once it is full, decoding reads each key with one or, if it spans two words, two unaligned loads.
+ */
+template<typename Key, bool Integral = std::is_integral<Key>::value>
+struct packed_key_codec {
+    static_assert(Integral, "Packed keys need an integral key type");
+};
+
+template<typename Key>
+struct packed_key_codec<Key, true> {
+    typedef typename std::make_unsigned<Key>::type unsigned_type;
+    static constexpr unsigned_type sign_bit = std::is_signed<Key>::value
+            ? unsigned_type(unsigned_type(1) << (sizeof(Key) * 8 - 1)) : unsigned_type(0);
+
+    // maps the key to an unsigned value with the same order
+    static uint64_t to_ordered(Key key) {
+        return uint64_t(unsigned_type(unsigned_type(key) ^ sign_bit));
+    }
+
+    static Key from_ordered(uint64_t value) {
+        return Key(unsigned_type(unsigned_type(value) ^ sign_bit));
+    }
+
+    static uint8_t bit_width(uint64_t value) {
+        return value == 0 ? 0 : uint8_t(64 - __builtin_clzll(value));
+    }
+
+    template<typename Writer, typename Array>
+    static void encode(Writer& w, const Array& array) {
+        if (array.empty()) {
+            return;
+        }
+        auto base = to_ordered(array.front().first);
+        auto width = bit_width(to_ordered(array.back().first) - base);
+        w.put(base);
+        w.put_u8(width);
+        if (width == 0) {
+            return;
+        }
+        uint64_t word = 0;
+        unsigned used = 0;
+        for (auto& entry : array) {
+            auto delta = to_ordered(entry.first) - base;
+            word |= delta << used;
+            used += width;
+            if (used >= 64) {
+                w.put(word);
+                used -= 64;
+                // the bits of delta that did not fit into the full word
+                word = used == 0 ? 0 : delta >> (width - used);
+            }
+        }
+        if (used != 0) {
+            w.put(word);
+        }
+    }
+
+    template<typename Array>
+    static void decode(wire_reader& r, Array& array) {
+        if (array.empty()) {
+            return;
+        }
+        uint64_t base;
+        r.get(base);
+        auto width = r.get_u8();
+        if (width == 0) {
+            for (auto& entry : array) {
+                entry.first = from_ordered(base);
+            }
+            return;
+        }
+        auto nwords = (array.size() * width + 63) / 64;
+        auto data = r.get_bytes(nwords * sizeof(uint64_t));
+        auto mask = width == 64 ? ~uint64_t(0) : ((uint64_t(1) << width) - 1);
+        size_t bit = 0;
+        for (auto& entry : array) {
+            auto word = bit / 64;
+            auto offset = bit % 64;
+            uint64_t lo, hi = 0;
+            std::memcpy(&lo, data + word * sizeof(uint64_t), sizeof(uint64_t));
+            if (offset + width > 64) {
+                std::memcpy(&hi, data + (word + 1) * sizeof(uint64_t), sizeof(uint64_t));
+                hi <<= (64 - offset);
+            }
+            entry.first = from_ordered(base + (((lo >> offset) | hi) & mask));
+            bit += width;
+        }
+    }
+};
+
+/**
+ * @brief Writes a logical or physical pointer
+ */
+template<typename Writer, typename Pointer>
+void encode_pointer(Writer& w, Pointer ptr, uint8_t flags) {
+    if (flags & node_format::compact_pointers) {
+        w.put_varint(ptr.value);
+    } else {
+        w.put(ptr);
+    }
+}
+
+template<typename Pointer>
+void decode_pointer(wire_reader& r, Pointer& ptr, uint8_t flags) {
+    if (flags & node_format::compact_pointers) {
+        ptr.value = r.get_varint();
+    } else {
+        r.get(ptr);
+    }
+}
+
+/**
+ * @brief Writes and reads the values of a node array
+ *
+ * Inner nodes store logical pointers which are allocated from a dense counter and children next to each other were
+ * mostly allocated close in time, so they are written as zigzag encoded differences to the previous entry.
+ */
+template<typename T>
+struct entry_value_codec {
+    entry_value_codec(uint8_t) {
+    }
+
+    template<typename Writer>
+    void encode(Writer& w, const T& value) {
+        w.put(value);
+    }
+
+    void decode(wire_reader& r, T& value) {
+        r.get(value);
+    }
+};
+
+template<>
+struct entry_value_codec<logical_pointer> {
+    uint8_t flags;
+    uint64_t previous = 0;
+
+    entry_value_codec(uint8_t flags)
+            : flags(flags) {
+    }
+
+    template<typename Writer>
+    void encode(Writer& w, logical_pointer value) {
+        if (flags & node_format::compact_pointers) {
+            auto delta = int64_t(value.value - previous);
+            w.put_varint((uint64_t(delta) << 1) ^ uint64_t(delta >> 63));
+            previous = value.value;
+        } else {
+            w.put(value);
+        }
+    }
+
+    void decode(wire_reader& r, logical_pointer& value) {
+        if (flags & node_format::compact_pointers) {
+            auto zigzag = r.get_varint();
+            auto delta = (zigzag >> 1) ^ (~(zigzag & 1) + 1);
+            value.value = previous + delta;
+            previous = value.value;
+        } else {
+            r.get(value);
+        }
+    }
+};
+
+/**
+ * @brief Writes a key that is not part of a node array (low and high keys)
+ */
+template<typename Key, bool ByteString = byte_string_key<Key>::value>
+struct single_key_codec {
+    template<typename Writer>
+    static void encode(Writer& w, const Key& key) {
+        w.put(key);
+    }
+
+    static void decode(wire_reader& r, Key& key) {
+        r.get(key);
+    }
+};
+
+template<typename Key>
+struct single_key_codec<Key, true> {
+    typedef byte_string_key<Key> bytes;
+
+    template<typename Writer>
+    static void encode(Writer& w, const Key& key) {
+        w.put_varint(bytes::size(key));
+        w.put_bytes(bytes::data(key), bytes::size(key));
+    }
+
+    static void decode(wire_reader& r, Key& key) {
+        auto length = r.get_varint();
+        key = bytes::make(std::string(reinterpret_cast<const char*>(r.get_bytes(length)), length));
+    }
+};
+
+/**
+ * @brief Packs the keys of a node array, key_formats allows the packed layout only for integral keys
+ */
+template<typename Writer, typename Key, typename T>
+void encode_packed_keys(Writer& w, const std::vector<std::pair<Key, T>>& array, std::true_type) {
+    packed_key_codec<Key>::encode(w, array);
+}
+
+template<typename Writer, typename Key, typename T>
+void encode_packed_keys(Writer&, const std::vector<std::pair<Key, T>>&, std::false_type) {
+}
+
+template<typename Key, typename T>
+void decode_packed_keys(wire_reader& r, std::vector<std::pair<Key, T>>& array, std::true_type) {
+    packed_key_codec<Key>::decode(r, array);
+}
+
+template<typename Key, typename T>
+void decode_packed_keys(wire_reader&, std::vector<std::pair<Key, T>>&, std::false_type) {
+}
+
+/**
+ * @brief Writes the entries of a node array followed by the node bounds
+ */
+template<typename Writer, typename Key, typename T>
+void encode_node_array(Writer& w, const std::vector<std::pair<Key, T>>& array, const Key& low_key,
+        const boost::optional<Key>& high_key, uint8_t flags) {
+    entry_value_codec<T> values(flags);
+    w.put_varint(array.size());
+    bool with_values = !(flags & node_format::split_values);
+    if (flags & node_format::packed_keys) {
+        encode_packed_keys(w, array, std::is_integral<Key>());
+        for (size_t i = 0; with_values && i < array.size(); ++i) {
+            values.encode(w, array[i].second);
+        }
+    } else {
+        key_array_codec<Key> keys;
+        keys.encode_prefix(w, array, flags);
+        for (auto& entry : array) {
+            keys.encode_key(w, entry.first);
+            if (with_values) {
+                values.encode(w, entry.second);
+            }
+        }
+    }
+    single_key_codec<Key>::encode(w, low_key);
+    w.put_u8(uint8_t(bool(high_key)));
+    if (high_key) {
+        single_key_codec<Key>::encode(w, *high_key);
+    }
+}
+
+template<typename Key, typename T>
+void decode_node_array(wire_reader& r, std::vector<std::pair<Key, T>>& array, Key& low_key,
+        boost::optional<Key>& high_key, uint8_t flags) {
+    entry_value_codec<T> values(flags);
+    auto size = r.get_varint();
+    array.resize(size);
+    bool with_values = !(flags & node_format::split_values);
+    if (flags & node_format::packed_keys) {
+        decode_packed_keys(r, array, std::is_integral<Key>());
+        for (size_t i = 0; with_values && i < array.size(); ++i) {
+            values.decode(r, array[i].second);
+        }
+    } else {
+        key_array_codec<Key> keys;
+        keys.decode_prefix(r, flags);
+        for (auto& entry : array) {
+            keys.decode_key(r, entry.first);
+            if (with_values) {
+                values.decode(r, entry.second);
+            }
+        }
+    }
+    single_key_codec<Key>::decode(r, low_key);
+    if (r.get_u8()) {
+        Key key;
+        single_key_codec<Key>::decode(r, key);
+        high_key = std::move(key);
+    } else {
+        high_key = boost::none;
+    }
+}
+
+/**
+ * @brief Writes the values of a node array written with node_format::split_values
+ *
+ * The block is prefixed by its length so that a reader can set the values aside without decoding them.
+ */
+template<typename Writer, typename Key, typename T>
+void encode_value_block(Writer& w, const std::vector<std::pair<Key, T>>& array, uint8_t flags) {
+    wire_sizer sizer;
+    entry_value_codec<T> sized(flags);
+    for (auto& entry : array) {
+        sized.encode(sizer, entry.second);
+    }
+    w.put_varint(sizer.size);
+    entry_value_codec<T> values(flags);
+    for (auto& entry : array) {
+        values.encode(w, entry.second);
+    }
+}
+
+/**
+ * @brief Fills in the values of a node array from a block written by encode_value_block (without the length prefix)
+ */
+template<typename Key, typename T>
+void decode_value_block(const uint8_t* block, std::vector<std::pair<Key, T>>& array, uint8_t flags) {
+    wire_reader r(block);
+    entry_value_codec<T> values(flags);
+    for (auto& entry : array) {
+        values.decode(r, entry.second);
+    }
+}
+
+} // namespace bdtree
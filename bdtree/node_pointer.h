@@ -97,7 +97,7 @@ namespace bdtree {
                     return false;
                 }
                 assert(!ec);
-                auto n = deserialize<Key, Value>(reinterpret_cast<const uint8_t*>(buf.data()), buf.length(), ptr_);
+                auto n = deserialize<Key, Value>(buf, ptr_);
                 resolve_operation<Key, Value, Backend> op(lptr_, ptr_, old_.get(), context, rc_version_);
                 if (!n->accept(op)) {
                     return false;
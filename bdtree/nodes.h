@@ -22,10 +22,16 @@
  */
 #pragma once
 #include <boost/optional.hpp>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
 #include <vector>
 
 #include "primitive_types.h"
 #include "base_types.h"
+#include "node_format.h"
+#include "leaf_index.h"
 
 namespace bdtree {
 	template<typename Key, typename Value>
@@ -34,10 +40,14 @@ namespace bdtree {
         typedef Value value_type;
         typedef node<Key, Value> type;
         static constexpr node_type_t node_type = node_type_t::InnerNode;
+        static constexpr uint8_t supported_formats = node_format::flags_mask & uint8_t(~node_format::split_values);
     public: // modifying functions
         void clear_deltas() {
             //stub to be API compatible with leaf_node_t
         }
+        void load_values() const {
+            //stub to be API compatible with leaf_node_t
+        }
         void set_pptr(physical_pointer pptr){
             //stub to be API compatible with leaf_node_t
         }
@@ -76,6 +86,21 @@ namespace bdtree {
             }
 #endif
         }
+
+        template<typename Writer>
+        void encode(Writer& w, uint8_t flags) const {
+            encode_node_array(w, array_, low_key_, high_key_, flags);
+            encode_pointer(w, right_link_, flags);
+            w.put(level);
+        }
+
+        void decode(wire_reader& r, uint8_t flags) {
+            decode_node_array(r, array_, low_key_, high_key_, flags);
+            decode_pointer(r, right_link_, flags);
+            r.get(level);
+            assert(level >= 0);
+            assert(bool(high_key_) == bool(right_link_.value));
+        }
     };
     
     template<typename Key, typename Value>
@@ -85,6 +110,7 @@ namespace bdtree {
         typedef Value value_type;
         typedef node<Key, Value> type;
         static constexpr node_type_t node_type = node_type_t::LeafNode;
+        static constexpr uint8_t supported_formats = node_format::flags_mask;
     public: // modifying functions
         void clear_deltas() {
             deltas_.clear();
@@ -94,9 +120,77 @@ namespace bdtree {
         }
         void set_level(int8_t l) {
         }
+        /**
+         * @brief Decodes the values of a leaf read in the node_format::split_values layout
+         *
+         * Until this is called only the keys of such a leaf are valid. Lookups that only compare keys never have to
+         * call this, everything that reads or copies the values does. The leaf may be shared through the cache, so
+         * concurrent callers wait for the first one to finish decoding.
+         */
+        void load_values() const {
+            auto state = value_state_.load(std::memory_order_acquire);
+            while (state != values_loaded) {
+                if (state == values_pending) {
+                    if (value_state_.compare_exchange_weak(state, values_loading, std::memory_order_acquire)) {
+                        auto& array = const_cast<std::vector<std::pair<key_type, Value>>&>(array_);
+                        decode_value_block(value_block_.get(), array, value_flags_);
+                        value_block_.reset();
+                        value_state_.store(values_loaded, std::memory_order_release);
+                        return;
+                    }
+                } else {
+                    std::this_thread::yield();
+                    state = value_state_.load(std::memory_order_acquire);
+                }
+            }
+        }
+        /**
+         * @brief Returns the hash index of a wide leaf, nullptr for narrow leaves and keys without index support
+         *
+         * The index is built on the first call with build set. It is neither serialized nor copied, this must
+         * therefore only be called on leaves that are not modified anymore, like the resolved leaves in the cache.
+         */
+        const leaf_hash_index<Key>* hash_index(bool build = true) const {
+            return hash_index(build, std::integral_constant<bool, leaf_index_traits<Key>::enabled>());
+        }
+
+        /**
+         * @brief Checks whether the leaf holds key, through the hash index if the leaf has one (see hash_index)
+         */
+        bool has_key(const key_type& key, bool build_index = true) const {
+            if (auto index = hash_index(build_index)) {
+                return index->find(array_, key) != array_.size();
+            }
+            key_compare<Key, Value> cmp;
+            return std::binary_search(array_.begin(), array_.end(), key, cmp);
+        }
     public: // construction/destruction
         leaf_node_t(physical_pointer pptr) : leaf_pptr_(pptr) {}
-        ~leaf_node_t() {}
+        leaf_node_t(const leaf_node_t& other)
+            : type(other)
+            , leaf_pptr_(other.leaf_pptr_)
+            , deltas_(other.deltas_)
+            , array_((other.load_values(), other.array_))
+            , low_key_(other.low_key_)
+            , high_key_(other.high_key_)
+            , right_link_(other.right_link_)
+        {}
+        leaf_node_t& operator= (const leaf_node_t& other) {
+            other.load_values();
+            leaf_pptr_ = other.leaf_pptr_;
+            deltas_ = other.deltas_;
+            array_ = other.array_;
+            low_key_ = other.low_key_;
+            high_key_ = other.high_key_;
+            right_link_ = other.right_link_;
+            value_block_.reset();
+            value_state_.store(values_loaded, std::memory_order_release);
+            delete hash_index_.exchange(nullptr);
+            return *this;
+        }
+        ~leaf_node_t() {
+            delete hash_index_.load();
+        }
     public: // data
         physical_pointer leaf_pptr_;//the pointer to the leaf node without deltas
         std::vector<physical_pointer> deltas_;
@@ -105,9 +199,39 @@ namespace bdtree {
         boost::optional<key_type> high_key_;
         logical_pointer right_link_ = {0};
         constexpr static int8_t level = 0;
+    private: // values not yet decoded
+        static constexpr uint8_t values_loaded = 0;
+        static constexpr uint8_t values_pending = 1;
+        static constexpr uint8_t values_loading = 2;
+        mutable std::atomic<uint8_t> value_state_{values_loaded};
+        mutable std::shared_ptr<const uint8_t> value_block_;
+        uint8_t value_flags_ = 0;
+    private: // point lookups
+        mutable std::atomic<const leaf_hash_index<Key>*> hash_index_{nullptr};
+
+        const leaf_hash_index<Key>* hash_index(bool build, std::true_type) const {
+            if (array_.size() < leaf_index_traits<Key>::min_entries) {
+                return nullptr;
+            }
+            auto index = hash_index_.load(std::memory_order_acquire);
+            if (!index && build) {
+                auto built = new leaf_hash_index<Key>(array_);
+                if (hash_index_.compare_exchange_strong(index, built, std::memory_order_acq_rel)) {
+                    index = built;
+                } else {
+                    delete built;
+                }
+            }
+            return index;
+        }
+
+        const leaf_hash_index<Key>* hash_index(bool, std::false_type) const {
+            return nullptr;
+        }
     public: // serialization
         template<typename Archiver>
         void visit(Archiver& ar) {
+            load_values();
             ar & array_;
             ar & low_key_;
             ar & high_key_;
@@ -125,5 +249,34 @@ namespace bdtree {
             }
 #endif
         }
+
+        template<typename Writer>
+        void encode(Writer& w, uint8_t flags) const {
+            load_values();
+            encode_node_array(w, array_, low_key_, high_key_, flags);
+            encode_pointer(w, right_link_, flags);
+            if (flags & node_format::split_values) {
+                encode_value_block(w, array_, flags);
+            }
+        }
+
+        void decode(wire_reader& r, uint8_t flags) {
+            decode_node_array(r, array_, low_key_, high_key_, flags);
+            decode_pointer(r, right_link_, flags);
+            assert(bool(high_key_) == bool(right_link_.value));
+            if (flags & node_format::split_values) {
+                auto length = r.get_varint();
+                auto block = r.get_bytes(length);
+                if (r.owner()) {
+                    // the backend keeps the buffer alive for us
+                    value_block_ = std::shared_ptr<const uint8_t>(r.owner(), block);
+                } else {
+                    auto copy = std::make_shared<std::vector<uint8_t>>(block, block + length);
+                    value_block_ = std::shared_ptr<const uint8_t>(copy, copy->data());
+                }
+                value_flags_ = flags;
+                value_state_.store(values_pending, std::memory_order_release);
+            }
+        }
     };
 }
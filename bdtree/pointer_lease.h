@@ -0,0 +1,101 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <bdtree/config.h>
+
+#include <tbb/enumerable_thread_specific.h>
+
+#include <cstdint>
+
+namespace bdtree {
+namespace detail {
+
+/**
+ * @brief Range of pointers a thread took from one table and hands out without going to the table
+ */
+struct pointer_lease {
+    uint64_t next = 0;
+    uint64_t end = 0;
+};
+
+/**
+ * @brief Returns a new id for a table, used to tell the leases of different tables apart
+ *
+ * Ids are never reused, so a lease of a destroyed table cannot be mistaken for one of a table created at the same
+ * address.
+ */
+uint64_t new_lease_owner();
+
+/**
+ * @brief Returns the calling thread's lease in leases, which belong to the table with the given id
+ *
+ * The last leases a thread used are found through a small per-thread cache, other lookups go to leases. A new lease
+ * is empty.
+ */
+pointer_lease& thread_lease(uint64_t owner, tbb::enumerable_thread_specific<pointer_lease>& leases);
+
+/**
+ * @brief The leases the threads hold on one table
+ *
+ * Every table keeps the leases of its threads, so a thread using many tables keeps all of its ranges. A copy of a
+ * table starts without leases, the pointers of a lease belong to the table that handed them out.
+ */
+class pointer_leases {
+public:
+    pointer_leases() = default;
+
+    pointer_leases(const pointer_leases&) {
+    }
+
+    pointer_leases& operator= (const pointer_leases&) {
+        return *this;
+    }
+
+    pointer_lease& local() {
+        return thread_lease(owner_, leases_);
+    }
+
+private:
+    const uint64_t owner_ = new_lease_owner();
+    tbb::enumerable_thread_specific<pointer_lease> leases_;
+};
+
+template <typename Pointer, typename Table>
+auto next_ptr(Table& table, pointer_leases& leases, int) -> decltype(Pointer(table.reserve_ptrs(uint64_t(1)))) {
+    auto& lease = leases.local();
+    if (lease.next == lease.end) {
+        Pointer first = table.reserve_ptrs(PTR_LEASE_SIZE);
+        lease.next = first.value;
+        lease.end = first.value + PTR_LEASE_SIZE;
+    }
+    return Pointer{lease.next++};
+}
+
+template <typename Pointer, typename Table>
+Pointer next_ptr(Table& table, pointer_leases&, long) {
+    return table.get_next_ptr();
+}
+
+} // namespace detail
+} // namespace bdtree
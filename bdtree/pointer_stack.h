@@ -0,0 +1,113 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <bdtree/primitive_types.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace bdtree {
+
+/**
+ * @brief Stack of the logical pointers on the path from the root to the current node
+ *
+ * Offers the subset of the std::stack interface the operations use. The entries are kept inline up to Capacity, which
+ * covers the height of any realistic tree, so creating and copying an operation_context does not allocate. Deeper
+ * stacks, e.g. while following many right links during a split or merge, spill into a vector.
+ */
+template<size_t Capacity>
+class basic_pointer_stack {
+public:
+    typedef logical_pointer value_type;
+    typedef size_t size_type;
+
+    basic_pointer_stack() = default;
+
+    basic_pointer_stack(const basic_pointer_stack& other)
+            : size_(other.size_), overflow_(other.overflow_) {
+        std::copy(other.inline_, other.inline_ + std::min(size_, Capacity), inline_);
+    }
+
+    basic_pointer_stack& operator= (const basic_pointer_stack& other) {
+        size_ = other.size_;
+        std::copy(other.inline_, other.inline_ + std::min(size_, Capacity), inline_);
+        overflow_ = other.overflow_;
+        return *this;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    size_type size() const {
+        return size_;
+    }
+
+    logical_pointer& top() {
+        assert(size_ > 0);
+        return size_ > Capacity ? overflow_.back() : inline_[size_ - 1];
+    }
+
+    const logical_pointer& top() const {
+        assert(size_ > 0);
+        return size_ > Capacity ? overflow_.back() : inline_[size_ - 1];
+    }
+
+    void push(logical_pointer lptr) {
+        if (size_ < Capacity) {
+            inline_[size_] = lptr;
+        } else {
+            overflow_.push_back(lptr);
+        }
+        ++size_;
+    }
+
+    void pop() {
+        assert(size_ > 0);
+        if (size_ > Capacity) {
+            overflow_.pop_back();
+        }
+        --size_;
+    }
+
+    friend bool operator== (const basic_pointer_stack& lhs, const basic_pointer_stack& rhs) {
+        return lhs.size_ == rhs.size_ && std::equal(lhs.inline_, lhs.inline_ + std::min(lhs.size_, Capacity), rhs.inline_)
+                && lhs.overflow_ == rhs.overflow_;
+    }
+
+    friend bool operator!= (const basic_pointer_stack& lhs, const basic_pointer_stack& rhs) {
+        return !(lhs == rhs);
+    }
+
+private:
+    size_type size_ = 0;
+    logical_pointer inline_[Capacity];
+    std::vector<logical_pointer> overflow_;
+};
+
+typedef basic_pointer_stack<16> pointer_stack;
+
+} // namespace bdtree
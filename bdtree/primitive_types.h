@@ -33,7 +33,7 @@ namespace bdtree {
         key_compare(Compare compare) : compare_(compare) {}
         
         template<typename T>
-        bool operator() (const Key k, const std::pair<Key, T>& p) {
+        bool operator() (const Key& k, const std::pair<Key, T>& p) {
             return compare_(k, p.first);
         }
         
@@ -43,6 +43,9 @@ namespace bdtree {
         }
     };
     
+    // ids of the process-wide default source, only valid for backends without their own tx id source; a handle on a
+    // backend with its own source (e.g. basic_memory_backend<clock_tx_id_source>) must take its id from
+    // next_tx_id(backend)
     extern uint64_t get_next_tx_id();
     extern void got_tx_id(uint64_t tx_id);
     extern uint64_t get_last_tx_id();
@@ -84,7 +87,8 @@ namespace bdtree {
         DeleteDelta,
         SplitDelta,
         RemoveDelta,
-        MergeDelta
+        MergeDelta,
+        ValueBlob
     };
 
 }
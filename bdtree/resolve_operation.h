@@ -23,7 +23,6 @@
 #pragma once
 #include <cassert>
 #include <algorithm>
-#include <stack>
 
 #include <bdtree/config.h>
 #include "forward_declarations.h"
@@ -63,6 +62,9 @@ namespace bdtree {
 
         bool visit(leaf_node<Key, Value>& n) override {
             key_compare<Key, Value> cmp;
+            if (!deltas.empty()) {
+                n.load_values();
+            }
             std::vector<physical_pointer> old_deltas = std::move(n.deltas_);
             for (auto iter = deltas.rbegin(); iter != deltas.rend(); ++iter) {
                 n.deltas_.push_back(iter->first);
@@ -71,7 +73,7 @@ namespace bdtree {
                 case node_type_t::InsertDelta:
                 {
                     insert_delta<Key, Value>* d = static_cast<insert_delta<Key, Value>*>(i);
-                    auto ins_pos = std::lower_bound(n.array_.begin(), n.array_.end(), d->value.first, cmp);
+                    auto ins_pos = key_lower_bound(n.array_.begin(), n.array_.end(), d->value.first, cmp);
                     assert(ins_pos == n.array_.end() || ins_pos->first != d->value.first);
                     n.array_.insert(ins_pos, d->value);
                 }
@@ -79,7 +81,7 @@ namespace bdtree {
                 case node_type_t::DeleteDelta:
                 {
                     delete_delta<Key, Value>* d = static_cast<delete_delta<Key, Value>*>(i);
-                    auto del_pos = std::lower_bound(n.array_.begin(), n.array_.end(), d->key, cmp);
+                    auto del_pos = key_lower_bound(n.array_.begin(), n.array_.end(), d->key, cmp);
                     assert(del_pos != n.array_.end() && del_pos->first == d->key);
                     n.array_.erase(del_pos);
                 }
@@ -142,7 +144,7 @@ namespace bdtree {
             if (ec) {
                 return false;
             }
-            auto res = deserialize<Key, Value>(reinterpret_cast<const uint8_t*>(buf.data()), buf.length(), node.next);
+            auto res = deserialize<Key, Value>(buf, node.next);
             return res->accept(*this);
         }
     };
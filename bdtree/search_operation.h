@@ -24,6 +24,8 @@
 
 #include <algorithm>
 
+#include <boost/optional.hpp>
+
 #include "forward_declarations.h"
 #include "util.h"
 #include "iterator.h"
@@ -106,21 +108,206 @@ bdtree_iterator<Key, Value, Backend> lower_bound_with_context(const Key & key,
             key, bound);
 }
 
+/**
+ * @brief Path to the leaf the last operation of a map handle ended in
+ *
+ * An operation on a key within the range of that leaf starts its search at the leaf, an operation on a key within the
+ * range of its parent starts at the parent, everything else starts at the root. The ranges are those seen by the last
+ * operation; if the tree changed since, the search climbs back up through fix_stack. A finger is not synchronized and
+ * must not be shared between threads.
+ */
+template<typename Key, typename Value, typename Backend>
+struct finger {
+    struct key_range {
+        Key low_key_;
+        boost::optional<Key> high_key_;
+    };
+
+    decltype(operation_context<Key, Value, Backend>::node_stack) node_stack;
+    key_range leaf;
+    key_range parent;
+    bool has_parent = false;
+
+    /**
+     * @brief Sets up the stack of context for a search for key
+     */
+    void start(const Key& key, operation_context<Key, Value, Backend>& context) const {
+        if (node_stack.empty()) {
+            return;
+        }
+        if (is_in_range(leaf, key, search_bound::LAST_SMALLER_EQUAL)) {
+            context.node_stack = node_stack;
+        } else if (has_parent && is_in_range(parent, key, search_bound::LAST_SMALLER_EQUAL)) {
+            context.node_stack = node_stack;
+            context.node_stack.pop();
+        }
+    }
+
+    void record(operation_context<Key, Value, Backend>& context, node_pointer<Key, Value>* np) {
+        assert(context.node_stack.top() == np->lptr_);
+        leaf.low_key_ = np->as_leaf()->low_key_;
+        leaf.high_key_ = np->as_leaf()->high_key_;
+        if (has_parent && node_stack == context.node_stack) {
+            // same path as before, the parent range is refreshed when the path changes
+            return;
+        }
+        node_stack = context.node_stack;
+        has_parent = false;
+        if (node_stack.size() < 2) {
+            return;
+        }
+        node_stack.pop();
+        auto parent_np = context.get_from_cache(node_stack.top());
+        node_stack.push(np->lptr_);
+        if (parent_np && parent_np->node_->get_node_type() == node_type_t::InnerNode) {
+            parent.low_key_ = parent_np->as_inner()->low_key_;
+            parent.high_key_ = parent_np->as_inner()->high_key_;
+            has_parent = true;
+        }
+    }
+};
+
 template<typename Key, typename Value, typename Backend>
 std::pair<node_pointer<Key, Value>*, operation_context<Key, Value, Backend>> lower_node_bound(const Key & key,
-        Backend& backend, logical_table_cache<Key, Value, Backend>& cache, uint64_t tx_id) {
+        Backend& backend, logical_table_cache<Key, Value, Backend>& cache, uint64_t tx_id,
+        finger<Key, Value, Backend>* f = nullptr) {
     operation_context<Key, Value, Backend> context{backend, cache, tx_id};
 
-    logical_pointer lptr{1};
-    context.node_stack.push(lptr);
+    if (f) {
+        f->start(key, context);
+    }
+    if (context.node_stack.empty()) {
+        logical_pointer lptr{1};
+        context.node_stack.push(lptr);
+    }
     node_pointer<Key, Value>* res = lower_bound_node_with_context(key, context, search_bound::LAST_SMALLER_EQUAL);
+    if (f) {
+        f->record(context, res);
+    }
     return std::make_pair(res, std::move(context));
 }
 
+/**
+ * @brief Checks whether key is in the tree
+ *
+ * If the cached inner nodes lead to a leaf whose current version has a filter in the cache and the filter rules the
+ * key out, the leaf is not read at all. Otherwise that version of the leaf is searched and a filter for it is added;
+ * only if the cached inner nodes do not lead to the leaf, the tree is searched as usual.
+ */
+template<typename Key, typename Value, typename Backend>
+bool contains_key(const Key& key, Backend& backend, logical_table_cache<Key, Value, Backend>& cache, uint64_t tx_id) {
+    {
+        operation_context<Key, Value, Backend> context{backend, cache, tx_id};
+        key_compare<Key, Value> cmp;
+        auto np = context.get_from_cache(logical_pointer{1});
+        while (np && np->node_->get_node_type() == node_type_t::InnerNode) {
+            auto& n = *np->as_inner();
+            if (!is_in_range(n, key, search_bound::LAST_SMALLER_EQUAL)) {
+                break;
+            }
+            auto lptr = last_smaller_equal(n.array_.begin(), n.array_.end(), key, cmp)->second;
+            if (n.level == 1) {
+                auto txid = tx_id_source(backend).last();
+                std::error_code ec;
+                auto pptr = context.get_ptr_table().read(lptr, ec);
+                if (ec) {
+                    break;
+                }
+                auto filter = cache.filters().find(lptr, std::get<1>(pptr));
+                if (filter && filter->covers(key) && !filter->may_contain(key)) {
+                    return false;
+                }
+                auto leafp = cache.get_without_cache(lptr, txid, pptr, context);
+                if (leafp && leafp->node_->get_node_type() == node_type_t::LeafNode
+                        && is_in_range(*leafp->as_leaf(), key, search_bound::LAST_SMALLER_EQUAL)) {
+                    auto leaf = leafp->as_leaf();
+                    cache.filters().add(leafp->lptr_, leafp->rc_version_, *leaf);
+                    return leaf->has_key(key);
+                }
+                break;
+            }
+            np = context.get_from_cache(lptr);
+        }
+    }
+    operation_context<Key, Value, Backend> context{backend, cache, tx_id};
+    auto np = learned_leaf_bound(key, context);
+    if (np == nullptr) {
+        np = lower_node_bound(key, backend, cache, tx_id).first;
+    }
+    auto leaf = np->as_leaf();
+    cache.filters().add(np->lptr_, np->rc_version_, *leaf);
+    return leaf->has_key(key);
+}
+
+/**
+ * @brief Builds the learned index of the cache from the inner nodes just above the leaves
+ *
+ * A node that disappears while the level is read was merged concurrently, the level is then read again. Returns false
+ * if the tree is a single leaf or the level kept changing, the previous index is dropped in these cases.
+ */
+template<typename Key, typename Value, typename Backend>
+bool build_learned_index(Backend& backend, logical_table_cache<Key, Value, Backend>& cache, uint64_t tx_id) {
+    constexpr unsigned max_attempts = 8;
+    for (unsigned attempt = 0; attempt < max_attempts; ++attempt) {
+        operation_context<Key, Value, Backend> context{backend, cache, tx_id};
+        auto np = context.get_from_cache(logical_pointer{1});
+        if (np == nullptr || np->node_->get_node_type() != node_type_t::InnerNode) {
+            break;
+        }
+        while (np != nullptr && np->as_inner()->level > 1) {
+            np = context.get_from_cache(np->as_inner()->array_.front().second);
+        }
+        typename learned_leaf_index<Key>::entries_type entries;
+        while (np != nullptr) {
+            auto& n = *np->as_inner();
+            entries.insert(entries.end(), n.array_.begin(), n.array_.end());
+            if (!n.high_key_) {
+                cache.set_learned_index(std::make_shared<learned_leaf_index<Key>>(std::move(entries)));
+                return true;
+            }
+            np = context.get_from_cache(n.right_link_);
+        }
+    }
+    cache.set_learned_index(nullptr);
+    return false;
+}
+
+/**
+ * @brief Finds the leaf for key through the learned index of the cache
+ *
+ * On success the context holds the stack root, leaf. Returns nullptr if there is no index or the leaf it predicts
+ * does not cover key (anymore).
+ */
+template<typename Key, typename Value, typename Backend>
+node_pointer<Key, Value>* learned_leaf_bound(const Key& key, operation_context<Key, Value, Backend>& context) {
+    auto index = context.cache.learned_index();
+    if (!index) {
+        return nullptr;
+    }
+    auto lptr = index->find(key);
+    if (lptr.value != 0) {
+        auto np = context.get_without_cache(lptr);
+        if (np && np->node_->get_node_type() == node_type_t::LeafNode
+                && is_in_range(*np->as_leaf(), key, search_bound::LAST_SMALLER_EQUAL)) {
+            context.node_stack.push(logical_pointer{1});
+            context.node_stack.push(lptr);
+            return np;
+        }
+    }
+    if (index->mispredicted()) {
+        context.cache.set_learned_index(nullptr);
+    }
+    return nullptr;
+}
+
 template<typename Key, typename Value, typename Backend>
 bdtree_iterator<Key, Value, Backend> lower_bound(const Key & key, Backend& backend,
-        logical_table_cache<Key, Value, Backend>& cache, uint64_t tx_id) {
-    auto res = lower_node_bound(key, backend, cache, tx_id);
+        logical_table_cache<Key, Value, Backend>& cache, uint64_t tx_id, finger<Key, Value, Backend>* f = nullptr) {
+    operation_context<Key, Value, Backend> context{backend, cache, tx_id};
+    if (auto np = learned_leaf_bound(key, context)) {
+        return bdtree_iterator<Key, Value, Backend>(std::move(context), np, key);
+    }
+    auto res = lower_node_bound(key, backend, cache, tx_id, f);
     return bdtree_iterator<Key, Value, Backend>(std::move(res.second), res.first, key);
 }
 
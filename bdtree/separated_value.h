@@ -0,0 +1,266 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <bdtree/config.h>
+#include <bdtree/primitive_types.h>
+#include <bdtree/serialize_buffer.h>
+
+#include <crossbow/Serializer.hpp>
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+namespace bdtree {
+
+/**
+ * @brief Tree value that is stored out of line when it is large
+ *
+ * Use separated_value<T> as the value type of a tree to keep the leaves dense. Values whose serialized size exceeds
+ * Threshold are written to the node table as objects of their own when they are inserted; leaves, their consolidations,
+ * splits and merges only carry the physical pointer to that object. The value is fetched from the node table the first
+ * time it is accessed through get (or bdtree_iterator::value) and shared by all copies of the entry afterwards.
+ */
+template<typename T, size_t Threshold = MAX_NODE_SIZE / 8>
+class separated_value {
+public:
+    typedef T value_type;
+    static constexpr size_t threshold = Threshold;
+
+    separated_value() = default;
+
+    separated_value(T value)
+            : value_(std::move(value)) {
+    }
+
+    separated_value(const separated_value& other)
+            : ref_(other.ref_), value_(other.value_), fetched_(std::atomic_load(&other.fetched_)) {
+    }
+
+    separated_value& operator= (const separated_value& other) {
+        ref_ = other.ref_;
+        value_ = other.value_;
+        std::atomic_store(&fetched_, std::atomic_load(&other.fetched_));
+        return *this;
+    }
+
+    bool is_separated() const {
+        return ref_.value != 0;
+    }
+
+    physical_pointer reference() const {
+        return ref_;
+    }
+
+    /**
+     * @brief Returns the value, values stored out of line are read from the node table on first access
+     */
+    template<typename NodeTable>
+    const T& get(NodeTable& node_table, std::error_code& ec) const {
+        if (!is_separated()) {
+            return value_;
+        }
+        auto fetched = std::atomic_load(&fetched_);
+        if (fetched) {
+            return *fetched;
+        }
+        auto buf = node_table.read(ref_, ec);
+        if (ec) {
+            return value_;
+        }
+        assert(node_type_t(uint8_t(buf.data()[0])) == node_type_t::ValueBlob);
+        std::shared_ptr<T> value = std::make_shared<T>();
+        crossbow::deserialize(*value, reinterpret_cast<const uint8_t*>(buf.data()) + 1);
+        std::shared_ptr<const T> expected;
+        fetched = value;
+        if (!std::atomic_compare_exchange_strong(&fetched_, &expected, fetched)) {
+            fetched = expected;
+        }
+        return *fetched;
+    }
+
+    template<typename NodeTable>
+    const T& get(NodeTable& node_table) const {
+        std::error_code ec;
+        auto& res = get(node_table, ec);
+        if (ec) {
+            throw std::system_error(ec);
+        }
+        return res;
+    }
+
+    /**
+     * @brief Writes the value to the node table if it exceeds the threshold
+     *
+     * Returns the entry to store in the leaf: either a copy of this value or a reference to the written object.
+     */
+    template<typename NodeTable>
+    separated_value store(NodeTable& node_table) const {
+        if (is_separated()) {
+            return *this;
+        }
+        crossbow::sizer sizer;
+        sizer & value_;
+        if (sizer.size <= Threshold) {
+            return *this;
+        }
+        serialize_buffer data;
+        data.get().resize(sizer.size + 1);
+        data.get()[0] = uint8_t(node_type_t::ValueBlob);
+        crossbow::serializer_into_array ser(data.get().data() + 1);
+        ser & value_;
+        separated_value res;
+        res.ref_ = node_table.next_ptr();
+        node_table.insert(res.ref_, data.data(), data.size());
+        return res;
+    }
+
+    /**
+     * @brief Removes the out of line object, called once the entry has been removed from the tree
+     *
+     * Threads holding an older version of the leaf may still read the object, it is retired rather than removed.
+     */
+    template<typename NodeTable>
+    void release(NodeTable& node_table) const {
+        if (is_separated()) {
+            node_table.retire(ref_);
+        }
+    }
+
+    /**
+     * @brief Removes the out of line object of a value that never became visible
+     */
+    template<typename NodeTable>
+    void discard(NodeTable& node_table) const {
+        if (is_separated()) {
+            std::error_code ec;
+            node_table.remove(ref_, ec);
+        }
+    }
+
+    /**
+     * @brief Returns the value with its out of line object at ref, for copying the object elsewhere
+     */
+    separated_value relocated(physical_pointer ref) const {
+        assert(is_separated());
+        separated_value res(*this);
+        res.ref_ = ref;
+        return res;
+    }
+
+    friend bool operator== (const separated_value& lhs, const separated_value& rhs) {
+        return lhs.ref_ == rhs.ref_ && (lhs.is_separated() || lhs.value_ == rhs.value_);
+    }
+    friend bool operator!= (const separated_value& lhs, const separated_value& rhs) {
+        return !(lhs == rhs);
+    }
+
+    template<typename Archiver>
+    void visit(Archiver& ar) {
+        ar & ref_;
+        ar & value_;
+    }
+
+private:
+    physical_pointer ref_ = {0};
+    T value_;
+    mutable std::shared_ptr<const T> fetched_;
+};
+
+/**
+ * @brief Hooks the tree operations call to store, load and release values
+ *
+ * Values are stored in the leaves as they are, only separated_value has an object of its own in the node table.
+ */
+template<typename Value>
+struct value_storage {
+    typedef Value loaded_type;
+
+    template<typename NodeTable>
+    static const Value& store(const Value& value, NodeTable&) {
+        return value;
+    }
+
+    template<typename NodeTable>
+    static const Value& load(const Value& value, NodeTable&) {
+        return value;
+    }
+
+    template<typename NodeTable>
+    static void discard(const Value&, const Value&, NodeTable&) {
+    }
+
+    template<typename NodeTable>
+    static void release(const Value&, NodeTable&) {
+    }
+
+    /// Moves an object stored out of line, fun gets its physical pointer and returns the new one
+    template<typename Fun>
+    static void relocate(Value&, Fun) {
+    }
+
+    static constexpr bool separates = false;
+};
+
+template<typename T, size_t Threshold>
+struct value_storage<separated_value<T, Threshold>> {
+    typedef separated_value<T, Threshold> value_type;
+    typedef T loaded_type;
+
+    template<typename NodeTable>
+    static value_type store(const value_type& value, NodeTable& node_table) {
+        return value.store(node_table);
+    }
+
+    template<typename NodeTable>
+    static const T& load(const value_type& value, NodeTable& node_table) {
+        return value.get(node_table);
+    }
+
+    /// Releases a value stored for an insert that did not happen
+    template<typename NodeTable>
+    static void discard(const value_type& stored, const value_type& original, NodeTable& node_table) {
+        if (stored.reference() != original.reference()) {
+            stored.discard(node_table);
+        }
+    }
+
+    template<typename NodeTable>
+    static void release(const value_type& value, NodeTable& node_table) {
+        value.release(node_table);
+    }
+
+    template<typename Fun>
+    static void relocate(value_type& value, Fun fun) {
+        if (value.is_separated()) {
+            value = value.relocated(fun(value.reference()));
+        }
+    }
+
+    static constexpr bool separates = true;
+};
+
+} // namespace bdtree
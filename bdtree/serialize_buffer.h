@@ -0,0 +1,69 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace bdtree {
+
+/**
+ * @brief Lease of a buffer to serialize a node into before it is written to the node table
+ *
+ * The buffers come from a per-thread pool and go back to it, keeping their capacity, when the lease ends. The write
+ * path therefore does not allocate for the serialized nodes once every thread has seen nodes of the usual size.
+ */
+class serialize_buffer {
+public:
+    serialize_buffer()
+            : buffer_(acquire()) {
+    }
+
+    ~serialize_buffer() {
+        release(buffer_);
+    }
+
+    serialize_buffer(const serialize_buffer&) = delete;
+    serialize_buffer& operator= (const serialize_buffer&) = delete;
+
+    std::vector<uint8_t>& get() {
+        return *buffer_;
+    }
+
+    const char* data() const {
+        return reinterpret_cast<const char*>(buffer_->data());
+    }
+
+    uint32_t size() const {
+        return uint32_t(buffer_->size());
+    }
+
+private:
+    static std::vector<uint8_t>* acquire();
+    static void release(std::vector<uint8_t>* buffer);
+
+    std::vector<uint8_t>* buffer_;
+};
+
+} // namespace bdtree
@@ -29,7 +29,6 @@
 #include <bdtree/error_code.h>
 
 #include <functional>
-#include <stack>
 
 namespace bdtree {
 
@@ -41,16 +40,19 @@ private:
     static void consolidate_typed(NodeType* iorl, operation_context<Key, Value, Backend>& context,
             split_delta<Key, Value>* delta, logical_pointer split_lptr, physical_pointer split_pptr,
             uint64_t lptr_version, Func fun) {
+        key_compare<Key, Value> cmp;
         NodeType* consolidated = new NodeType(*iorl);
-        consolidated->array_.erase(consolidated->array_.begin() + consolidated->array_.size()/2, consolidated->array_.end());
+        consolidated->array_.erase(key_lower_bound(consolidated->array_.begin(), consolidated->array_.end(),
+                delta->right_key, cmp), consolidated->array_.end());
         consolidated->right_link_ = delta->new_right;
         consolidated->high_key_ = delta->right_key;
         consolidated->clear_deltas();
-        auto data = consolidated->serialize();
+        serialize_buffer data;
+        consolidated->serialize_into(data.get());
 
         auto& node_table = context.get_node_table();
-        auto pptr = node_table.get_next_ptr();
-        node_table.insert(pptr, reinterpret_cast<const char*>(data.data()), uint32_t(data.size()));
+        auto pptr = node_table.next_ptr();
+        node_table.insert(pptr, data.data(), data.size());
 
         auto& ptr_table = context.get_ptr_table();
         std::error_code ec;
@@ -82,7 +84,7 @@ private:
         if (ec) {
             throw std::system_error(ec);
         }
-        auto n = deserialize<Key, Value>(reinterpret_cast<const uint8_t*>(buf.data()), buf.length(), delta->next);
+        auto n = deserialize<Key, Value>(buf, delta->next);
         resolve_operation<Key, Value, Backend> op(split_lptr, delta->next, nullptr, context, lptr_version);
         if (!n->accept(op)) {
             return;
@@ -109,6 +111,33 @@ private:
         }
     }
 
+    // leaves are separated by the shortest key between both halves, inner nodes need their first entry as low key
+    static Key separator(leaf_node<Key, Value>* node, size_t pos) {
+        if (pos == 0) {
+            return node->array_[pos].first;
+        }
+        return key_separator<Key>::shortest(node->array_[pos - 1].first, node->array_[pos].first);
+    }
+
+    static Key separator(inner_node<Key, Value>* node, size_t pos) {
+        return node->array_[pos].first;
+    }
+
+    // Appends only ever fill the rightmost node of a level, splitting it in half would leave every other node half
+    // empty. When the key that caused the split lies beyond the last entry of the rightmost node, most entries stay
+    // on the left and the new right node gets just enough of them to stay clear of the merge threshold.
+    template<typename NodeType>
+    static size_t split_position(NodeType* to_split, const Key* hint) {
+        auto size = to_split->array_.size();
+        auto half = size / 2;
+        if (hint == nullptr || to_split->high_key_ || size < 4 || *hint < to_split->array_.back().first) {
+            return half;
+        }
+        auto right = size_t(double(size) * double(MIN_NODE_SIZE + MIN_NODE_SIZE / 4)
+                / double(to_split->serialized_size())) + 1;
+        return right >= size - half ? half : size - right;
+    }
+
 public:
     static void continue_split(logical_pointer split_lptr, physical_pointer split_pptr, uint64_t split_rc_version,
             split_delta<Key, Value> *delta, operation_context<Key, Value, Backend>& context) {
@@ -151,16 +180,17 @@ public:
             size_t nsize = inner->serialized_size();
             if (nsize >= MAX_NODE_SIZE) {
                 //split
-                split(parent, context);
+                split(parent, context, &delta->right_key);
                 continue;
             }
             inner_node<Key, Value>* new_inner = new inner_node<Key, Value>(*inner);
             auto i = iter - inner->array_.begin() + 1;//insert after the next smaller
             new_inner->array_.insert(new_inner->array_.begin() + i, std::make_pair(delta->right_key, delta->new_right));
-            auto data = new_inner->serialize();
+            serialize_buffer data;
+            new_inner->serialize_into(data.get());
 
-            auto pptr = node_table.get_next_ptr();
-            node_table.insert(pptr, reinterpret_cast<const char*>(data.data()), uint32_t(data.size()));
+            auto pptr = node_table.next_ptr();
+            node_table.insert(pptr, data.data(), data.size());
 
             auto lptr_version = ptr_table.update(parent->lptr_, pptr, parent->rc_version_, ec);
             if (!ec) {
@@ -185,31 +215,40 @@ public:
 
     template<typename NodeType>
     static void execute_split(node_pointer<Key, Value>* nodep, NodeType* to_split,
-            operation_context<Key, Value, Backend>& context) {
+            operation_context<Key, Value, Backend>& context, const Key* hint) {
         assert(nodep->node_ == to_split);
         auto& node_table = context.get_node_table();
-        auto right_pptr = node_table.get_next_ptr();
-        auto split_ptr = node_table.get_next_ptr();
+        auto right_pptr = node_table.next_ptr();
+        auto split_ptr = node_table.next_ptr();
         auto& ptr_table = context.get_ptr_table();
-        auto right_lptr = ptr_table.get_next_ptr();
+        auto right_lptr = ptr_table.next_ptr();
 
         auto right_lptr_version = ptr_table.insert(right_lptr, right_pptr);
 
+        to_split->load_values();
+        auto pos = split_position(to_split, hint);
         NodeType* right = new NodeType(right_pptr);
-        right->array_.insert(right->array_.begin(), to_split->array_.begin() + to_split->array_.size()/2, to_split->array_.end());
+        right->array_.insert(right->array_.begin(), to_split->array_.begin() + pos, to_split->array_.end());
         right->high_key_ = to_split->high_key_;
-        right->low_key_ = right->array_.front().first;
+        right->low_key_ = separator(to_split, pos);
+        if (pos != to_split->array_.size() / 2 && right->serialized_size() < MIN_NODE_SIZE + MIN_NODE_SIZE / 4) {
+            // entries of very different sizes, the estimate was off
+            pos = to_split->array_.size() / 2;
+            right->array_.assign(to_split->array_.begin() + pos, to_split->array_.end());
+            right->low_key_ = separator(to_split, pos);
+        }
         right->right_link_ = to_split->right_link_;
         right->set_level(to_split->level);
         assert(!to_split->high_key_ || *to_split->high_key_ == *right->high_key_);
-        std::vector<uint8_t> data = right->serialize();
-        node_table.insert(right_pptr, reinterpret_cast<const char*>(data.data()), uint32_t(data.size()));
+        serialize_buffer data;
+        right->serialize_into(data.get());
+        node_table.insert(right_pptr, data.data(), data.size());
         if (nodep->lptr_.value == 1) {
             // root split
             assert(to_split->low_key_ == null_key<Key>::value() && !to_split->high_key_);
-            logical_pointer lptr_left = ptr_table.get_next_ptr();
-            physical_pointer pptr_left = node_table.get_next_ptr();
-            physical_pointer pptr_newroot = node_table.get_next_ptr();
+            logical_pointer lptr_left = ptr_table.next_ptr();
+            physical_pointer pptr_left = node_table.next_ptr();
+            physical_pointer pptr_newroot = node_table.next_ptr();
             auto lptr_left_version = ptr_table.insert(lptr_left, pptr_left);
 
             node_pointer<Key, Value> *leftp = new node_pointer<Key, Value>(lptr_left, pptr_left, lptr_left_version);
@@ -219,18 +258,18 @@ public:
             new_root->array_.push_back(std::make_pair(null_key<Key>::value(), lptr_left));
             new_root->array_.push_back(std::make_pair(right->low_key_, right_lptr));
             new_root->set_level(int8_t(to_split->level + 1));
-            data = new_root->serialize();
-            node_table.insert(pptr_newroot, reinterpret_cast<const char *>(data.data()), uint32_t(data.size()));
+            new_root->serialize_into(data.get());
+            node_table.insert(pptr_newroot, data.data(), data.size());
 
             NodeType *left = new NodeType(pptr_left);
-            left->array_.insert(left->array_.begin(), to_split->array_.begin(), to_split->array_.begin() + to_split->array_.size()/2);
+            left->array_.insert(left->array_.begin(), to_split->array_.begin(), to_split->array_.begin() + pos);
             left->low_key_ = to_split->low_key_;
             left->high_key_ = right->low_key_;
             left->right_link_ = right_lptr;
             left->set_level(to_split->level);
             leftp->node_ = left;
-            data = left->serialize();
-            node_table.insert(pptr_left, reinterpret_cast<const char*>(data.data()), uint32_t(data.size()));
+            left->serialize_into(data.get());
+            node_table.insert(pptr_left, data.data(), data.size());
 
             std::error_code ec;
             auto rc_version = ptr_table.update(nodep->lptr_, pptr_newroot, nodep->rc_version_, ec);
@@ -274,8 +313,8 @@ public:
         split->new_right = right_lptr;
         split->right_key = right->low_key_;
         split->level = right->level;
-        data = split->serialize();
-        node_table.insert(split_ptr, reinterpret_cast<const char*>(data.data()), uint32_t(data.size()));
+        split->serialize_into(data.get());
+        node_table.insert(split_ptr, data.data(), data.size());
         std::error_code ec;
         auto rc_version = ptr_table.update(nodep->lptr_, split_ptr, nodep->rc_version_, ec);
         delete right;
@@ -297,12 +336,16 @@ public:
         }
     }
 
-    static void split(node_pointer<Key, Value>* node, operation_context<Key, Value, Backend>& context) {
+    /**
+     * @brief Splits node, hint is the key whose insertion made the node overflow, if known
+     */
+    static void split(node_pointer<Key, Value>* node, operation_context<Key, Value, Backend>& context,
+            const Key* hint = nullptr) {
         node_type_t nt = node->node_->get_node_type();
         if (nt == node_type_t::LeafNode) {
-            execute_split(node, node->as_leaf(), context);
+            execute_split(node, node->as_leaf(), context, hint);
         } else if (nt == node_type_t::InnerNode) {
-            execute_split(node, node->as_inner(), context);
+            execute_split(node, node->as_inner(), context, hint);
         }
     }
 };
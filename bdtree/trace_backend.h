@@ -0,0 +1,315 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <bdtree/decorated_backend.h>
+#include <bdtree/error_code.h>
+
+#include <crossbow/allocator.hpp>
+#include <crossbow/non_copyable.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace bdtree {
+
+/**
+ * @brief One call in a trace
+ *
+ * ptr, value and version are the fields of the backend_call_info of the call. Trace files start with a
+ * trace_file_header followed by the records, in the byte order of the recording machine.
+ */
+struct trace_record {
+    // start of the call relative to the start of the trace
+    uint64_t start_ns;
+
+    // time the call took in the recorded backend, saturating
+    uint32_t duration_ns;
+
+    // the recording thread, numbered in the order threads first called a traced backend
+    uint16_t thread;
+
+    // a backend_call
+    uint8_t call;
+
+    // 0, a backend_error or 0xff for any other error
+    uint8_t error;
+
+    uint64_t ptr;
+    uint64_t value;
+    uint64_t version;
+};
+
+static_assert(sizeof(trace_record) == 40, "Unexpected padding in trace records");
+
+namespace detail {
+
+constexpr uint64_t trace_magic = 0x3145434152544442ull; // "BDTRACE1"
+
+struct trace_file_header {
+    uint64_t magic;
+    uint64_t record_length;
+};
+
+uint8_t trace_error(const std::error_code& ec);
+
+/**
+ * @brief Records the calls passing through it into a trace file
+ *
+ * Every thread collects its records in a buffer of its own and writes them in batches; a batch may reach the file
+ * after a later one, readers sort the records by their start.
+ */
+class trace_writer : crossbow::non_copyable, crossbow::non_movable {
+public:
+    typedef std::chrono::steady_clock clock;
+
+    struct pending_call {
+        clock::time_point start;
+    };
+
+    explicit trace_writer(const std::string& path);
+
+    ~trace_writer();
+
+    pending_call begin(backend_call, size_t) {
+        return pending_call{clock::now()};
+    }
+
+    void end(pending_call& pending, const backend_call_info& info);
+
+    /**
+     * @brief Writes the records collected so far
+     */
+    void flush();
+
+    uint64_t records() const;
+
+private:
+    struct thread_buffer {
+        // taken by the owning thread and by flush, so it is only contended while a flush collects the buffer
+        std::mutex mutex;
+        std::vector<trace_record> records;
+        uint64_t count = 0;
+    };
+
+    thread_buffer& local_buffer();
+
+    void write(const std::vector<trace_record>& records);
+
+    int fd_;
+    clock::time_point start_;
+    uint64_t id_;
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<thread_buffer>> buffers_;
+    std::mutex write_mutex_;
+};
+
+} // namespace detail
+
+/**
+ * @brief Backend recording every table call of another backend into a trace file
+ *
+ * The wrapped backend is constructed from the arguments following the path. The file is complete once the backend is
+ * destroyed or flush returned. Tx ids and get_remote_ptr are not recorded.
+ */
+template <typename Backend>
+class trace_backend : public decorated_backend<Backend, detail::trace_writer> {
+public:
+    using decorated_backend<Backend, detail::trace_writer>::decorated_backend;
+
+    void flush() {
+        this->hook().flush();
+    }
+
+    uint64_t records() const {
+        return this->hook().records();
+    }
+};
+
+/**
+ * @brief Reads a trace file, the records are sorted by their start
+ */
+std::vector<trace_record> read_trace(const std::string& path);
+
+struct trace_replay_options {
+    // 1 issues the calls at their recorded times, 2 twice as fast, 0 as fast as possible
+    double speed = 1.0;
+};
+
+/**
+ * @brief Counters of one kind of call in a replay, mismatches are calls that failed differently than when recorded
+ */
+struct trace_replay_statistics {
+    uint64_t calls = 0;
+    uint64_t mismatches = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+};
+
+struct trace_replay_result {
+    std::array<trace_replay_statistics, num_backend_calls> calls;
+    uint64_t elapsed_ns = 0;
+
+    const trace_replay_statistics& operator[] (backend_call call) const {
+        return calls[size_t(call)];
+    }
+};
+
+namespace detail {
+
+template <typename Table>
+auto replay_reserve(Table& table, uint64_t count, int) -> decltype(table.reserve_ptrs(count)) {
+    return table.reserve_ptrs(count);
+}
+
+template <typename Table>
+auto replay_reserve(Table& table, uint64_t, long) -> decltype(table.get_next_ptr()) {
+    return table.get_next_ptr();
+}
+
+template <typename Backend>
+std::error_code replay_call(Backend& backend, const trace_record& record, std::vector<char>& buffer) {
+    auto& ptr_table = backend.get_ptr_table();
+    auto& node_table = backend.get_node_table();
+    logical_pointer lptr{record.ptr};
+    physical_pointer pptr{record.ptr};
+    std::error_code ec;
+    switch (backend_call(record.call)) {
+    case backend_call::ptr_next:
+        if (record.value == 0) {
+            ptr_table.get_next_ptr();
+        } else {
+            replay_reserve(ptr_table, record.value, 0);
+        }
+        break;
+    case backend_call::ptr_read:
+        ptr_table.read(lptr, ec);
+        break;
+    case backend_call::ptr_insert:
+        ptr_table.insert(lptr, physical_pointer{record.value}, ec);
+        break;
+    case backend_call::ptr_update:
+        ptr_table.update(lptr, physical_pointer{record.value}, record.version, ec);
+        break;
+    case backend_call::ptr_remove:
+        ptr_table.remove(lptr, record.version, ec);
+        break;
+    case backend_call::node_next:
+        if (record.value == 0) {
+            node_table.get_next_ptr();
+        } else {
+            replay_reserve(node_table, record.value, 0);
+        }
+        break;
+    case backend_call::node_read:
+        node_table.read(pptr, ec);
+        break;
+    case backend_call::node_insert:
+        buffer.resize(record.value);
+        node_table.insert(pptr, buffer.data(), buffer.size(), ec);
+        break;
+    case backend_call::node_remove:
+        node_table.remove(pptr, ec);
+        break;
+    }
+    return ec;
+}
+
+} // namespace detail
+
+/**
+ * @brief Issues the calls of a trace to a backend
+ *
+ * Every recorded thread is replayed by a thread of its own, which issues its calls in their recorded order and, unless
+ * the speed is 0, not before their recorded start divided by the speed. Calls use the recorded pointers and versions,
+ * pointers handed out by the backend are dropped; the backend should be in the state the recorded one was in when the
+ * trace started, usually empty. Nodes are written with the recorded length and zeroed content.
+ */
+template <typename Backend>
+trace_replay_result replay_trace(Backend& backend, const std::vector<trace_record>& records,
+        const trace_replay_options& options = trace_replay_options()) {
+    typedef std::chrono::steady_clock clock;
+    std::map<uint16_t, std::vector<const trace_record*>> threads;
+    for (auto& record : records) {
+        threads[record.thread].push_back(&record);
+    }
+    std::vector<trace_replay_result> results(threads.size());
+    std::vector<std::thread> workers;
+    auto start = clock::now();
+    auto result = results.begin();
+    for (auto& thread : threads) {
+        auto& calls = thread.second;
+        auto& res = *result++;
+        workers.emplace_back([&backend, &calls, &res, &options, start]() {
+            std::vector<char> buffer;
+            for (auto record : calls) {
+                if (options.speed > 0) {
+                    std::this_thread::sleep_until(start + std::chrono::nanoseconds(
+                            uint64_t(double(record->start_ns) / options.speed)));
+                }
+                auto call_start = clock::now();
+                std::error_code ec;
+                {
+                    crossbow::allocator alloc;
+                    (void) alloc;
+                    ec = detail::replay_call(backend, *record, buffer);
+                }
+                auto duration = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        clock::now() - call_start).count());
+                auto& stats = res.calls[record->call];
+                ++stats.calls;
+                if (detail::trace_error(ec) != record->error) {
+                    ++stats.mismatches;
+                }
+                stats.total_ns += duration;
+                stats.max_ns = std::max(stats.max_ns, duration);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    trace_replay_result res;
+    res.elapsed_ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count());
+    for (auto& r : results) {
+        for (size_t i = 0; i < num_backend_calls; ++i) {
+            res.calls[i].calls += r.calls[i].calls;
+            res.calls[i].mismatches += r.calls[i].mismatches;
+            res.calls[i].total_ns += r.calls[i].total_ns;
+            res.calls[i].max_ns = std::max(res.calls[i].max_ns, r.calls[i].max_ns);
+        }
+    }
+    return res;
+}
+
+} // namespace bdtree
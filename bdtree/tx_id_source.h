@@ -0,0 +1,153 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace bdtree {
+
+/**
+ * @brief Transaction ids taken from one process-wide counter
+ *
+ * A map handle gets its id from next, entries of the logical table cache are stamped with last before the pointer
+ * table is read. A cached entry is used by a handle if its stamp is not older than the handle's id. Any tx id source
+ * therefore has to return from next an id larger than every value last returned before, and last has to reach the
+ * ids handed out by next so that entries read after a handle was created are used by it. observe moves the source
+ * past an id obtained elsewhere.
+ */
+class alignas(64) global_tx_id_source {
+public:
+    global_tx_id_source()
+            : counter_(0x0u) {
+    }
+
+    global_tx_id_source(const global_tx_id_source&) = delete;
+    global_tx_id_source& operator= (const global_tx_id_source&) = delete;
+
+    uint64_t next() {
+        return ++counter_;
+    }
+
+    uint64_t last() const {
+        return counter_.load();
+    }
+
+    void observe(uint64_t tx_id) {
+        auto current = counter_.load();
+        while (current < tx_id && !counter_.compare_exchange_weak(current, tx_id)) {
+        }
+    }
+
+private:
+    std::atomic<uint64_t> counter_;
+};
+
+/**
+ * @brief Transaction ids derived from a monotonic clock
+ *
+ * next and last read the clock and write no shared state, so the cache line of a counter does not move between the
+ * cores that create map handles and resolve cache misses. last is one tick behind the clock: a handle created within
+ * the same tick as a cache entry was read does not use the entry and reads it once more. Ids passed to observe raise a
+ * floor; while the clock is behind it, next counts up from the floor.
+ */
+class alignas(64) clock_tx_id_source {
+public:
+    clock_tx_id_source()
+            : floor_(0x0u) {
+    }
+
+    clock_tx_id_source(const clock_tx_id_source&) = delete;
+    clock_tx_id_source& operator= (const clock_tx_id_source&) = delete;
+
+    uint64_t next() {
+        auto id = now();
+        auto floor = floor_.load();
+        while (floor >= id) {
+            if (floor_.compare_exchange_weak(floor, floor + 1)) {
+                return floor + 1;
+            }
+        }
+        return id;
+    }
+
+    uint64_t last() const {
+        return std::max(now() - 1, floor_.load());
+    }
+
+    void observe(uint64_t tx_id) {
+        auto floor = floor_.load();
+        while (floor < tx_id && !floor_.compare_exchange_weak(floor, tx_id)) {
+        }
+    }
+
+private:
+    static uint64_t now() {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    std::atomic<uint64_t> floor_;
+};
+
+/**
+ * @brief The source behind get_next_tx_id, get_last_tx_id and got_tx_id, used by backends without their own
+ */
+global_tx_id_source& default_tx_id_source();
+
+namespace detail {
+
+template <typename Backend>
+auto tx_id_source(Backend& backend, int) -> decltype(backend.get_tx_id_source()) {
+    return backend.get_tx_id_source();
+}
+
+template <typename Backend>
+global_tx_id_source& tx_id_source(Backend&, long) {
+    return default_tx_id_source();
+}
+
+} // namespace detail
+
+/**
+ * @brief Returns the tx id source of a backend
+ *
+ * A backend can provide its own source through get_tx_id_source(), returning a reference to an object with the
+ * interface of global_tx_id_source. Otherwise the process-wide default source is used.
+ */
+template <typename Backend>
+auto tx_id_source(Backend& backend) -> decltype(detail::tx_id_source(backend, 0)) {
+    return detail::tx_id_source(backend, 0);
+}
+
+/**
+ * @brief Returns the id for a new map handle on the backend
+ */
+template <typename Backend>
+uint64_t next_tx_id(Backend& backend) {
+    return tx_id_source(backend).next();
+}
+
+} // namespace bdtree
@@ -24,12 +24,18 @@
 
 #include <bdtree/base_types.h>
 #include <bdtree/forward_declarations.h>
+#include <bdtree/key_encoding.h>
+#include <bdtree/node_format.h>
 #include <bdtree/logical_table_cache.h>
 #include <bdtree/primitive_types.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstddef>
 #include <functional>
 #include <limits>
+#include <type_traits>
 
 namespace bdtree {
 
@@ -75,6 +81,13 @@ struct null_key<std::string> {
     }
 };
 
+template<>
+struct null_key<normalized_key> {
+    static normalized_key value() {
+        return normalized_key();
+    }
+};
+
 template<typename T, typename U>
 struct null_key<std::pair<T,U> > {
     static constexpr std::pair<T, U> value() {
@@ -96,15 +109,159 @@ struct null_key<std::tuple<T> > {
     }
 };
 
+/**
+ * @brief Computes the separator between two adjacent keys of a split leaf
+ *
+ * Returns a key s with left < s <= right. The generic version returns right, byte string keys return the shortest
+ * prefix of right that is still larger than left, which keeps split deltas and inner nodes small.
+ */
+template<typename Key, bool ByteString = byte_string_key<Key>::value>
+struct key_separator {
+    static Key shortest(const Key& left, const Key& right) {
+        return right;
+    }
+};
+
+template<typename Key>
+struct key_separator<Key, true> {
+    typedef byte_string_key<Key> bytes;
+
+    static Key shortest(const Key& left, const Key& right) {
+        assert(left < right);
+        auto l = bytes::data(left);
+        auto r = bytes::data(right);
+        auto length = std::min(bytes::size(left), bytes::size(right));
+        size_t i = 0;
+        while (i < length && l[i] == r[i]) {
+            ++i;
+        }
+        assert(i < bytes::size(right));
+        return bytes::make(std::string(r, i + 1));
+    }
+};
+
+/**
+ * @brief Selects interpolation search for the entries of inner and leaf nodes
+ *
+ * Enabled for arithmetic keys compared in their natural order. Specialize this to disable it for trees whose keys are
+ * far from uniformly distributed within a node.
+ */
+template<typename Key, typename Compare>
+struct interpolation_search {
+    static constexpr bool enabled = false;
+};
+
+template<typename Key, typename Value>
+struct interpolation_search<Key, key_compare<Key, Value, std::less<Key>>> {
+    static constexpr bool enabled = std::is_arithmetic<Key>::value;
+};
+
+namespace detail {
+
+template<bool Upper, typename RandomIt, typename T, typename Compare>
+RandomIt key_bound(RandomIt first, RandomIt last, const T& key, Compare cmp, std::false_type) {
+    return Upper ? std::upper_bound(first, last, key, cmp) : std::lower_bound(first, last, key, cmp);
+}
+
+/**
+ * Probes the position predicted by linear interpolation between the first and the last key and gallops from there
+ * towards the result. If the prediction is more than a few entries off, the keys are not uniform enough and a binary
+ * search over the remaining range takes over, so a mispredicting model costs only a handful of extra probes.
+ */
+template<bool Upper, typename RandomIt, typename T, typename Compare>
+RandomIt key_bound(RandomIt first, RandomIt last, const T& key, Compare cmp, std::true_type) {
+    auto before = [&key](const T& k) {
+        return Upper ? !(key < k) : k < key;
+    };
+    constexpr std::ptrdiff_t max_gallop = 16;
+    if (last - first <= max_gallop) {
+        return key_bound<Upper>(first, last, key, cmp, std::false_type());
+    }
+    if (!before(first->first)) {
+        return first;
+    }
+    if (before((last - 1)->first)) {
+        return last;
+    }
+    auto low = double(first->first);
+    auto high = double((last - 1)->first);
+    if (!(high > low)) {
+        // the keys are too dense to tell apart as doubles
+        return key_bound<Upper>(first, last, key, cmp, std::false_type());
+    }
+    auto offset = (double(key) - low) / (high - low) * double(last - first - 1);
+    if (!std::isfinite(offset)) {
+        return key_bound<Upper>(first, last, key, cmp, std::false_type());
+    }
+    offset = std::min(std::max(offset, 0.0), double(last - first - 1));
+    auto pos = first + std::ptrdiff_t(offset);
+    if (before(pos->first)) {
+        // the result is in (pos, last]
+        auto lo = pos + 1;
+        for (std::ptrdiff_t step = 1; step <= max_gallop && last - lo > step; step *= 2) {
+            auto probe = lo + (step - 1);
+            if (!before(probe->first)) {
+                return key_bound<Upper>(lo, probe, key, cmp, std::false_type());
+            }
+            lo = probe + 1;
+        }
+        return key_bound<Upper>(lo, last, key, cmp, std::false_type());
+    }
+    // the result is in [first, pos]
+    auto hi = pos;
+    for (std::ptrdiff_t step = 1; step <= max_gallop && hi - first > step; step *= 2) {
+        auto probe = hi - step;
+        if (before(probe->first)) {
+            return key_bound<Upper>(probe + 1, hi, key, cmp, std::false_type());
+        }
+        hi = probe;
+    }
+    return key_bound<Upper>(first, hi, key, cmp, std::false_type());
+}
+
+} // namespace detail
+
+/**
+ * @brief std::lower_bound over the entries of a node, using interpolation search where interpolation_search enables it
+ */
+template<typename RandomIt, typename T, typename Compare>
+RandomIt key_lower_bound(RandomIt first, RandomIt last, const T& key, Compare cmp) {
+    return detail::key_bound<false>(first, last, key, cmp,
+            std::integral_constant<bool, interpolation_search<T, Compare>::enabled>());
+}
+
+/**
+ * @brief std::upper_bound over the entries of a node, using interpolation search where interpolation_search enables it
+ */
+template<typename RandomIt, typename T, typename Compare>
+RandomIt key_upper_bound(RandomIt first, RandomIt last, const T& key, Compare cmp) {
+    return detail::key_bound<true>(first, last, key, cmp,
+            std::integral_constant<bool, interpolation_search<T, Compare>::enabled>());
+}
+
+/**
+ * @brief key_lower_bound over the entries of a resolved leaf, keys the leaf holds are found through its hash index
+ */
+template<typename Leaf, typename Key, typename Compare>
+auto leaf_lower_bound(Leaf& leaf, const Key& key, Compare cmp) -> decltype(leaf.array_.begin()) {
+    if (auto index = leaf.hash_index()) {
+        auto pos = index->find(leaf.array_, key);
+        if (pos != leaf.array_.size()) {
+            return leaf.array_.begin() + pos;
+        }
+    }
+    return key_lower_bound(leaf.array_.begin(), leaf.array_.end(), key, cmp);
+}
+
 template<typename ForwardIt, typename T, typename Compare>
 ForwardIt last_smaller_equal(ForwardIt first, ForwardIt last, const T& value, Compare cmp) {
-    auto iter = std::upper_bound(first, last, value, cmp);
+    auto iter = key_upper_bound(first, last, value, cmp);
     return (iter == first ? last : --iter);
 }
 
 template<typename ForwardIt, typename T, typename Compare>
 ForwardIt last_smaller(ForwardIt first, ForwardIt last, const T& value, Compare cmp) {
-    auto iter = std::lower_bound(first, last, value, cmp);
+    auto iter = key_lower_bound(first, last, value, cmp);
     return (iter == first ? last : --iter);
 }
 
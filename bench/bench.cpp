@@ -0,0 +1,653 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include <bdtree/bdtree.h>
+#include <bdtree/config.h>
+#include <bdtree/file_backend.h>
+#include <bdtree/latency_backend.h>
+#include <bdtree/memory_backend.h>
+
+#include <crossbow/allocator.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+// bijective, spreads consecutive record numbers over the key space
+uint64_t scramble(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+template <typename Key>
+struct key_maker;
+
+template <>
+struct key_maker<uint64_t> {
+    static const char* name() {
+        return "uint64";
+    }
+
+    static uint64_t make(uint64_t record) {
+        return scramble(record + 1);
+    }
+};
+
+template <>
+struct key_maker<std::string> {
+    static const char* name() {
+        return "string";
+    }
+
+    static std::string make(uint64_t record) {
+        return "user" + std::to_string(scramble(record + 1));
+    }
+};
+
+template <typename Value>
+struct value_maker;
+
+template <>
+struct value_maker<uint64_t> {
+    static const char* name() {
+        return "uint64";
+    }
+
+    static uint64_t make(uint64_t record, size_t) {
+        return record;
+    }
+};
+
+template <>
+struct value_maker<std::string> {
+    static const char* name() {
+        return "string";
+    }
+
+    static std::string make(uint64_t record, size_t size) {
+        return std::string(size, char('a' + record % 26));
+    }
+};
+
+/**
+ * @brief Zipfian distributed numbers in [0, items), 0 being the most popular (Gray et al., as in YCSB)
+ */
+class zipfian_generator {
+public:
+    explicit zipfian_generator(uint64_t items, double theta = 0.99)
+            : items_(std::max<uint64_t>(items, 1)), theta_(theta) {
+        double zeta2 = 1.0 + std::pow(0.5, theta_);
+        zetan_ = 0.0;
+        for (uint64_t i = 1; i <= items_; ++i) {
+            zetan_ += 1.0 / std::pow(double(i), theta_);
+        }
+        alpha_ = 1.0 / (1.0 - theta_);
+        eta_ = (1.0 - std::pow(2.0 / double(items_), 1.0 - theta_)) / (1.0 - zeta2 / zetan_);
+        second_ = 1.0 + std::pow(0.5, theta_);
+    }
+
+    uint64_t next(std::mt19937_64& random) const {
+        auto u = std::uniform_real_distribution<double>(0.0, 1.0)(random);
+        auto uz = u * zetan_;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < second_) {
+            return 1;
+        }
+        return std::min(items_ - 1, uint64_t(double(items_) * std::pow(eta_ * u - eta_ + 1.0, alpha_)));
+    }
+
+private:
+    uint64_t items_;
+    double theta_;
+    double zetan_;
+    double alpha_;
+    double eta_;
+    double second_;
+};
+
+enum class distribution {
+    uniform,
+    zipfian,
+    latest,
+};
+
+const char* to_string(distribution d) {
+    switch (d) {
+    case distribution::uniform:
+        return "uniform";
+    case distribution::zipfian:
+        return "zipfian";
+    case distribution::latest:
+        return "latest";
+    }
+    return "unknown";
+}
+
+enum op_type : unsigned {
+    op_read,
+    op_update,
+    op_insert,
+    op_scan,
+    op_read_modify_write,
+    num_ops
+};
+
+const char* op_names[num_ops] = {"read", "update", "insert", "scan", "read_modify_write"};
+
+struct workload {
+    char name;
+    std::array<double, num_ops> mix;
+    distribution keys;
+};
+
+// the core workloads of YCSB
+const workload workloads[] = {
+    {'A', {{0.5, 0.5, 0.0, 0.0, 0.0}}, distribution::zipfian},
+    {'B', {{0.95, 0.05, 0.0, 0.0, 0.0}}, distribution::zipfian},
+    {'C', {{1.0, 0.0, 0.0, 0.0, 0.0}}, distribution::zipfian},
+    {'D', {{0.95, 0.0, 0.05, 0.0, 0.0}}, distribution::latest},
+    {'E', {{0.0, 0.0, 0.05, 0.95, 0.0}}, distribution::zipfian},
+    {'F', {{0.5, 0.0, 0.0, 0.0, 0.5}}, distribution::zipfian},
+};
+
+enum class cache_mode {
+    shared,
+    thread,
+    cold,
+};
+
+const char* to_string(cache_mode mode) {
+    switch (mode) {
+    case cache_mode::shared:
+        return "shared";
+    case cache_mode::thread:
+        return "thread";
+    case cache_mode::cold:
+        return "cold";
+    }
+    return "unknown";
+}
+
+struct bench_config {
+    std::string workloads = "A";
+    std::string backend = "memory";
+    std::string directory;
+    std::string key_type = "uint64";
+    std::string value_type = "uint64";
+    size_t value_size = 100;
+    uint64_t records = 100000;
+    uint64_t operations = 100000;
+    unsigned threads = 1;
+    cache_mode cache = cache_mode::shared;
+    bool override_keys = false;
+    distribution keys = distribution::zipfian;
+    uint64_t max_scan_length = 100;
+    uint64_t latency_ns = 0;
+    uint64_t seed = 0;
+};
+
+struct thread_stats {
+    std::array<std::vector<uint64_t>, num_ops> latencies;
+    std::array<uint64_t, num_ops> failed;
+
+    thread_stats() {
+        failed.fill(0);
+    }
+};
+
+double percentile(const std::vector<uint64_t>& sorted, double p) {
+    auto index = size_t(std::ceil(p * double(sorted.size())));
+    return double(sorted[std::max<size_t>(index, 1) - 1]) / 1000.0;
+}
+
+/**
+ * @brief Loads a tree and runs workloads on it, printing one JSON object per phase
+ *
+ * Every operation is a map handle of its own with a new tx id, like a transaction of one statement. Updates erase the
+ * key and insert the new value, the map has no update in place.
+ */
+template <typename Key, typename Value, typename Backend>
+class ycsb {
+    typedef bdtree::logical_table_cache<Key, Value, Backend> cache_type;
+    typedef bdtree::map<Key, Value, Backend> map_type;
+
+public:
+    ycsb(Backend& backend, const bench_config& config)
+            : backend_(backend), config_(config), zipfian_(config.records), thread_caches_(config.threads) {
+        if (config_.cache != cache_mode::cold) {
+            shared_cache_.reset(new cache_type());
+        }
+        crossbow::allocator alloc;
+        (void) alloc;
+        cache_type cache;
+        map_type(backend_, shared_cache_ ? *shared_cache_ : cache, bdtree::next_tx_id(backend_), true);
+    }
+
+    void load() {
+        auto stats = run_threads([this](unsigned thread, cache_type& cache, std::mt19937_64&, thread_stats& stats) {
+            for (uint64_t record = thread; record < config_.records; record += config_.threads) {
+                execute(stats, op_insert, cache, [this, record](map_type& map) {
+                    return map.insert(key_maker<Key>::make(record), value_maker<Value>::make(record, config_.value_size));
+                });
+            }
+        });
+        next_record_ = config_.records;
+        inserted_ = config_.records;
+        report("load", '-', distribution::uniform, config_.records, stats);
+    }
+
+    void run(const workload& w) {
+        auto keys = config_.override_keys ? config_.keys : w.keys;
+        auto stats = run_threads([this, &w, keys](unsigned thread, cache_type& cache, std::mt19937_64& random,
+                thread_stats& stats) {
+            auto operations = config_.operations / config_.threads
+                    + (thread < config_.operations % config_.threads ? 1 : 0);
+            std::discrete_distribution<unsigned> ops(w.mix.begin(), w.mix.end());
+            for (uint64_t i = 0; i < operations; ++i) {
+                auto op = op_type(ops(random));
+                if (op == op_insert) {
+                    auto record = next_record_.fetch_add(1);
+                    execute(stats, op, cache, [this, record](map_type& map) {
+                        return map.insert(key_maker<Key>::make(record),
+                                value_maker<Value>::make(record, config_.value_size));
+                    });
+                    auto inserted = inserted_.load();
+                    while (inserted < record + 1 && !inserted_.compare_exchange_weak(inserted, record + 1)) {
+                    }
+                    continue;
+                }
+                auto record = choose(keys, random);
+                auto key = key_maker<Key>::make(record);
+                switch (op) {
+                case op_read:
+                    execute(stats, op, cache, [&key](map_type& map) {
+                        auto iter = map.find(key);
+                        return iter != map.end() && iter->first == key;
+                    });
+                    break;
+                case op_update:
+                    execute(stats, op, cache, [this, &key, record](map_type& map) {
+                        auto erased = map.erase(key);
+                        return map.insert(key, value_maker<Value>::make(record + 1, config_.value_size)) && erased;
+                    });
+                    break;
+                case op_scan: {
+                    auto length = std::uniform_int_distribution<uint64_t>(1, config_.max_scan_length)(random);
+                    execute(stats, op, cache, [&key, length](map_type& map) {
+                        uint64_t scanned = 0;
+                        for (auto iter = map.find(key); iter != map.end() && scanned < length; ++iter) {
+                            ++scanned;
+                        }
+                        return scanned > 0;
+                    });
+                    break;
+                }
+                case op_read_modify_write:
+                    execute(stats, op, cache, [this, &key, record](map_type& map) {
+                        auto iter = map.find(key);
+                        if (iter == map.end() || iter->first != key) {
+                            return false;
+                        }
+                        auto erased = map.erase(key);
+                        return map.insert(key, value_maker<Value>::make(record + 1, config_.value_size)) && erased;
+                    });
+                    break;
+                default:
+                    break;
+                }
+            }
+        });
+        report("run", w.name, keys, config_.operations, stats);
+    }
+
+private:
+    uint64_t choose(distribution keys, std::mt19937_64& random) const {
+        auto count = std::max<uint64_t>(inserted_.load(), 1);
+        switch (keys) {
+        case distribution::uniform:
+            return std::uniform_int_distribution<uint64_t>(0, count - 1)(random);
+        case distribution::zipfian:
+            return scramble(zipfian_.next(random)) % count;
+        case distribution::latest: {
+            auto back = zipfian_.next(random);
+            return back < count ? count - 1 - back : 0;
+        }
+        }
+        return 0;
+    }
+
+    template <typename Fun>
+    void execute(thread_stats& stats, op_type op, cache_type& cache, Fun fun) {
+        auto start = clock_type::now();
+        bool ok;
+        {
+            crossbow::allocator alloc;
+            (void) alloc;
+            if (config_.cache == cache_mode::cold) {
+                cache_type cold;
+                map_type map(backend_, cold, bdtree::next_tx_id(backend_));
+                ok = fun(map);
+            } else {
+                map_type map(backend_, cache, bdtree::next_tx_id(backend_));
+                ok = fun(map);
+            }
+        }
+        stats.latencies[op].push_back(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock_type::now() - start).count()));
+        if (!ok) {
+            ++stats.failed[op];
+        }
+    }
+
+    template <typename Fun>
+    std::pair<double, thread_stats> run_threads(Fun fun) {
+        std::vector<thread_stats> stats(config_.threads);
+        std::atomic<bool> go(false);
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < config_.threads; ++t) {
+            threads.emplace_back([this, t, &fun, &stats, &go]() {
+                std::mt19937_64 random(scramble(config_.seed) + streams_.fetch_add(1));
+                cache_type* cache = shared_cache_.get();
+                if (config_.cache == cache_mode::thread) {
+                    if (!thread_caches_[t]) {
+                        thread_caches_[t].reset(new cache_type());
+                    }
+                    cache = thread_caches_[t].get();
+                }
+                while (!go.load()) {
+                    std::this_thread::yield();
+                }
+                cache_type cold;
+                fun(t, cache ? *cache : cold, random, stats[t]);
+            });
+        }
+        auto start = clock_type::now();
+        go.store(true);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        auto seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+        thread_stats res;
+        for (auto& s : stats) {
+            for (unsigned op = 0; op < num_ops; ++op) {
+                res.latencies[op].insert(res.latencies[op].end(), s.latencies[op].begin(), s.latencies[op].end());
+                res.failed[op] += s.failed[op];
+            }
+        }
+        return std::make_pair(seconds, std::move(res));
+    }
+
+    void report(const char* phase, char name, distribution keys, uint64_t operations,
+            std::pair<double, thread_stats>& result) {
+        std::ostringstream out;
+        out << "{\"phase\":\"" << phase << "\"";
+        if (name != '-') {
+            out << ",\"workload\":\"" << name << "\"";
+        }
+        out << ",\"backend\":\"" << config_.backend << "\""
+            << ",\"key\":\"" << key_maker<Key>::name() << "\""
+            << ",\"value\":\"" << value_maker<Value>::name() << "\""
+            << ",\"value_size\":" << config_.value_size
+            << ",\"threads\":" << config_.threads
+            << ",\"cache\":\"" << to_string(config_.cache) << "\""
+            << ",\"distribution\":\"" << to_string(keys) << "\""
+            << ",\"records\":" << config_.records
+            << ",\"operations\":" << operations
+            << ",\"latency_ns\":" << config_.latency_ns
+            << ",\"consolidate_at\":" << bdtree::CONSOLIDATE_AT
+            << ",\"max_node_size\":" << bdtree::MAX_NODE_SIZE
+            << ",\"min_node_size\":" << bdtree::MIN_NODE_SIZE
+            << ",\"seconds\":" << result.first
+            << ",\"throughput\":" << double(operations) / result.first
+            << ",\"ops\":{";
+        bool first = true;
+        for (unsigned op = 0; op < num_ops; ++op) {
+            auto& latencies = result.second.latencies[op];
+            if (latencies.empty()) {
+                continue;
+            }
+            std::sort(latencies.begin(), latencies.end());
+            uint64_t total = 0;
+            for (auto l : latencies) {
+                total += l;
+            }
+            out << (first ? "" : ",") << "\"" << op_names[op] << "\":{"
+                << "\"count\":" << latencies.size()
+                << ",\"failed\":" << result.second.failed[op]
+                << ",\"mean_us\":" << double(total) / double(latencies.size()) / 1000.0
+                << ",\"p50_us\":" << percentile(latencies, 0.5)
+                << ",\"p95_us\":" << percentile(latencies, 0.95)
+                << ",\"p99_us\":" << percentile(latencies, 0.99)
+                << ",\"p999_us\":" << percentile(latencies, 0.999)
+                << ",\"max_us\":" << double(latencies.back()) / 1000.0 << "}";
+            first = false;
+        }
+        out << "}}";
+        std::cout << out.str() << std::endl;
+    }
+
+    Backend& backend_;
+    const bench_config& config_;
+    zipfian_generator zipfian_;
+    std::unique_ptr<cache_type> shared_cache_;
+    std::vector<std::unique_ptr<cache_type>> thread_caches_;
+    std::atomic<uint64_t> next_record_{0};
+    std::atomic<uint64_t> inserted_{0};
+    std::atomic<uint64_t> streams_{0};
+};
+
+template <typename Key, typename Value, typename Backend>
+void run_workloads(Backend& backend, const bench_config& config) {
+    ycsb<Key, Value, Backend> bench(backend, config);
+    bench.load();
+    for (auto name : config.workloads) {
+        for (auto& w : workloads) {
+            if (w.name == name) {
+                bench.run(w);
+            }
+        }
+    }
+}
+
+template <typename Backend>
+void run_types(Backend& backend, const bench_config& config) {
+    if (config.key_type == "uint64" && config.value_type == "uint64") {
+        run_workloads<uint64_t, uint64_t>(backend, config);
+    } else if (config.key_type == "uint64") {
+        run_workloads<uint64_t, std::string>(backend, config);
+    } else if (config.value_type == "uint64") {
+        run_workloads<std::string, uint64_t>(backend, config);
+    } else {
+        run_workloads<std::string, std::string>(backend, config);
+    }
+}
+
+// the benchmark initializes a new tree, which must not overwrite one already stored by the backend
+template <typename Backend>
+void check_empty(Backend&) {
+}
+
+void check_empty(bdtree::file_backend& backend) {
+    if (!backend.empty()) {
+        throw std::runtime_error("the directory of the file backend already holds a tree");
+    }
+}
+
+template <typename Backend>
+void check_empty(bdtree::latency_backend<Backend>& backend) {
+    check_empty(backend.get_backend());
+}
+
+template <typename Backend, typename... Args>
+void run_backend(const bench_config& config, Args&&... args) {
+    if (config.latency_ns == 0) {
+        Backend backend(std::forward<Args>(args)...);
+        check_empty(backend);
+        run_types(backend, config);
+        return;
+    }
+    bdtree::latency_backend_config latency(bdtree::latency_distribution::constant(config.latency_ns));
+    bdtree::latency_backend<Backend> backend(latency, std::forward<Args>(args)...);
+    check_empty(backend);
+    run_types(backend, config);
+}
+
+void usage(const char* name) {
+    std::cerr << "usage: " << name << " [options]\n"
+            << "  -w <workloads>  YCSB workloads to run after loading, in order, e.g. ABCDEF (default A)\n"
+            << "  -r <records>    records loaded (default 100000)\n"
+            << "  -o <ops>        operations of every workload (default 100000)\n"
+            << "  -t <threads>    client threads (default 1)\n"
+            << "  -k <type>       key type: uint64 or string (default uint64)\n"
+            << "  -v <type>       value type: uint64 or string (default uint64)\n"
+            << "  -z <bytes>      size of string values (default 100)\n"
+            << "  -d <dist>       key distribution for all workloads: uniform, zipfian or latest\n"
+            << "  -c <cache>      shared, thread (one cache per thread) or cold (a new cache per operation)\n"
+            << "  -x <length>     maximal scan length (default 100)\n"
+            << "  -b <backend>    memory or file (default memory)\n"
+            << "  -D <directory>  directory of the file backend, must not hold a tree\n"
+            << "  -l <ns>         latency added to every backend call\n"
+            << "  -s <seed>       seed of the random generators\n"
+            << "Results are printed as one JSON object per phase. CONSOLIDATE_AT and the node sizes are set when\n"
+            << "configuring the build and reported with the results.\n";
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    bench_config config;
+    int opt;
+    while ((opt = getopt(argc, argv, "w:r:o:t:k:v:z:d:c:x:b:D:l:s:h")) != -1) {
+        std::string arg = optarg ? optarg : "";
+        switch (opt) {
+        case 'w':
+            config.workloads = arg;
+            break;
+        case 'r':
+            config.records = std::strtoull(optarg, nullptr, 10);
+            break;
+        case 'o':
+            config.operations = std::strtoull(optarg, nullptr, 10);
+            break;
+        case 't':
+            config.threads = unsigned(std::max(1ul, std::strtoul(optarg, nullptr, 10)));
+            break;
+        case 'k':
+            config.key_type = arg;
+            break;
+        case 'v':
+            config.value_type = arg;
+            break;
+        case 'z':
+            config.value_size = std::strtoull(optarg, nullptr, 10);
+            break;
+        case 'd':
+            config.override_keys = true;
+            if (arg == "uniform") {
+                config.keys = distribution::uniform;
+            } else if (arg == "zipfian") {
+                config.keys = distribution::zipfian;
+            } else if (arg == "latest") {
+                config.keys = distribution::latest;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'c':
+            if (arg == "shared") {
+                config.cache = cache_mode::shared;
+            } else if (arg == "thread") {
+                config.cache = cache_mode::thread;
+            } else if (arg == "cold") {
+                config.cache = cache_mode::cold;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'x':
+            config.max_scan_length = std::max(1ull, std::strtoull(optarg, nullptr, 10));
+            break;
+        case 'b':
+            config.backend = arg;
+            break;
+        case 'D':
+            config.directory = arg;
+            break;
+        case 'l':
+            config.latency_ns = std::strtoull(optarg, nullptr, 10);
+            break;
+        case 's':
+            config.seed = std::strtoull(optarg, nullptr, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    auto valid_type = [](const std::string& type) {
+        return type == "uint64" || type == "string";
+    };
+    if (optind != argc || !valid_type(config.key_type) || !valid_type(config.value_type)
+            || (config.backend != "memory" && config.backend != "file")
+            || (config.backend == "file" && config.directory.empty())) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    crossbow::allocator::init();
+    try {
+        if (config.backend == "memory") {
+            run_backend<bdtree::memory_backend>(config);
+        } else {
+            run_backend<bdtree::file_backend>(config, config.directory);
+        }
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
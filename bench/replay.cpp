@@ -0,0 +1,137 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include <bdtree/file_backend.h>
+#include <bdtree/latency_backend.h>
+#include <bdtree/memory_backend.h>
+#include <bdtree/trace_backend.h>
+
+#include <crossbow/allocator.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+namespace {
+
+struct replay_config {
+    std::string trace;
+    std::string backend = "memory";
+    std::string directory;
+    bdtree::trace_replay_options options;
+    uint64_t latency_ns = 0;
+    uint64_t bandwidth = 0;
+};
+
+void usage(const char* name) {
+    std::cerr << "usage: " << name << " [options] <trace>\n"
+            << "  -s <speed>      speed relative to the recording, 0 replays as fast as possible (default 1)\n"
+            << "  -b <backend>    memory or file (default memory)\n"
+            << "  -d <directory>  directory of the file backend, should not hold a tree\n"
+            << "  -l <ns>         latency added to every call\n"
+            << "  -w <bytes/s>    bandwidth of the link to the backend\n";
+}
+
+template <typename Backend>
+void replay(Backend& backend, const std::vector<bdtree::trace_record>& records, const replay_config& config) {
+    auto res = bdtree::replay_trace(backend, records, config.options);
+    std::cout << std::left << std::setw(12) << "call" << std::right << std::setw(12) << "calls"
+            << std::setw(12) << "mismatches" << std::setw(12) << "mean us" << std::setw(12) << "max us" << "\n";
+    for (size_t i = 0; i < bdtree::num_backend_calls; ++i) {
+        auto call = bdtree::backend_call(i);
+        auto& stats = res[call];
+        if (stats.calls == 0) {
+            continue;
+        }
+        std::cout << std::left << std::setw(12) << bdtree::to_string(call) << std::right << std::setw(12)
+                << stats.calls << std::setw(12) << stats.mismatches << std::fixed << std::setprecision(2)
+                << std::setw(12) << double(stats.total_ns) / double(stats.calls) / 1000.0
+                << std::setw(12) << double(stats.max_ns) / 1000.0 << "\n";
+    }
+    std::cout << "replayed " << records.size() << " calls in " << double(res.elapsed_ns) / 1e9 << " s\n";
+}
+
+template <typename Backend, typename... Args>
+void replay_on(const std::vector<bdtree::trace_record>& records, const replay_config& config, Args&&... args) {
+    if (config.latency_ns == 0 && config.bandwidth == 0) {
+        Backend backend(std::forward<Args>(args)...);
+        replay(backend, records, config);
+        return;
+    }
+    bdtree::latency_backend_config latency(bdtree::latency_distribution::constant(config.latency_ns));
+    latency.bandwidth = config.bandwidth;
+    bdtree::latency_backend<Backend> backend(latency, std::forward<Args>(args)...);
+    replay(backend, records, config);
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    replay_config config;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:b:d:l:w:h")) != -1) {
+        switch (opt) {
+        case 's':
+            config.options.speed = std::strtod(optarg, nullptr);
+            break;
+        case 'b':
+            config.backend = optarg;
+            break;
+        case 'd':
+            config.directory = optarg;
+            break;
+        case 'l':
+            config.latency_ns = std::strtoull(optarg, nullptr, 10);
+            break;
+        case 'w':
+            config.bandwidth = std::strtoull(optarg, nullptr, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind + 1 != argc || (config.backend == "file" && config.directory.empty())
+            || (config.backend != "file" && config.backend != "memory")) {
+        usage(argv[0]);
+        return 1;
+    }
+    config.trace = argv[optind];
+
+    crossbow::allocator::init();
+    try {
+        auto records = bdtree::read_trace(config.trace);
+        if (config.backend == "memory") {
+            replay_on<bdtree::memory_backend>(records, config);
+        } else {
+            replay_on<bdtree::file_backend>(records, config, config.directory);
+        }
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -24,19 +24,21 @@
 
 namespace bdtree {
 
-std::atomic<uint64_t> tx_id_counter;
+global_tx_id_source tx_id_counter;
+
+global_tx_id_source& default_tx_id_source() {
+    return tx_id_counter;
+}
 
 uint64_t get_next_tx_id() {
-    return ++tx_id_counter;
+    return tx_id_counter.next();
 }
 
 void got_tx_id(uint64_t tx_id) {
-    uint64_t old_value = tx_id_counter;
-    while (old_value < tx_id)
-        tx_id_counter.compare_exchange_strong(old_value, tx_id);
+    tx_id_counter.observe(tx_id);
 }
 
-uint64_t get_last_tx_id() { return tx_id_counter.load(); }
+uint64_t get_last_tx_id() { return tx_id_counter.last(); }
 
 }
 
@@ -0,0 +1,633 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include <bdtree/file_backend.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bdtree {
+
+namespace {
+
+constexpr uint32_t tombstone_length = 0xffffffffu;
+constexpr size_t scan_chunk = 1 << 20;
+
+// set an entry (insert and update) or remove it
+constexpr uint8_t ptr_set = 1;
+constexpr uint8_t ptr_remove = 2;
+
+struct node_record {
+    uint64_t pptr;
+    uint32_t length;
+    uint32_t checksum;
+};
+
+struct ptr_record {
+    uint8_t op;
+    uint8_t padding[3];
+    uint32_t checksum;
+    uint64_t lptr;
+    uint64_t pptr;
+    uint64_t version;
+};
+
+struct checkpoint_header {
+    uint64_t log_seq;
+    uint64_t counter;
+    uint64_t entries;
+    uint64_t checksum;
+};
+
+struct checkpoint_entry {
+    uint64_t lptr;
+    uint64_t pptr;
+    uint64_t version;
+};
+
+std::system_error io_error(const std::string& what) {
+    return std::system_error(errno, std::system_category(), what);
+}
+
+const std::array<uint32_t, 256>& crc_table() {
+    static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> res;
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            res[i] = c;
+        }
+        return res;
+    }();
+    return table;
+}
+
+uint32_t crc32(const char* data, size_t length, uint32_t crc = 0) {
+    auto& table = crc_table();
+    crc = ~crc;
+    for (size_t i = 0; i < length; ++i) {
+        crc = table[(crc ^ uint8_t(data[i])) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint32_t checksum(const node_record& record, const char* data) {
+    auto crc = crc32(reinterpret_cast<const char*>(&record), offsetof(node_record, checksum));
+    return record.length == tombstone_length ? crc : crc32(data, record.length, crc);
+}
+
+uint32_t checksum(const ptr_record& record) {
+    return crc32(reinterpret_cast<const char*>(&record.lptr), sizeof(ptr_record) - offsetof(ptr_record, lptr),
+            record.op);
+}
+
+std::string log_path(const std::string& directory, uint64_t seq) {
+    return directory + "/ptr.log." + std::to_string(seq);
+}
+
+bool file_exists(const std::string& path) {
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0;
+}
+
+void sync_directory(const std::string& directory) {
+    int fd = ::open(directory.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw io_error("open " + directory);
+    }
+    ::fsync(fd);
+    ::close(fd);
+}
+
+/**
+ * Reads a file front to back in large chunks, for the recovery scans
+ */
+class file_scanner {
+public:
+    explicit file_scanner(const std::string& path)
+            : fd_(::open(path.c_str(), O_RDONLY)) {
+        if (fd_ < 0) {
+            throw io_error("open " + path);
+        }
+        struct stat st;
+        if (::fstat(fd_, &st) != 0) {
+            ::close(fd_);
+            throw io_error("fstat " + path);
+        }
+        size_ = uint64_t(st.st_size);
+    }
+
+    ~file_scanner() {
+        ::close(fd_);
+    }
+
+    file_scanner(const file_scanner&) = delete;
+    file_scanner& operator= (const file_scanner&) = delete;
+
+    // returns false at the end of the file
+    bool next(char* res, size_t length) {
+        while (buffer_.size() - position_ < length) {
+            buffer_.erase(buffer_.begin(), buffer_.begin() + position_);
+            position_ = 0;
+            auto have = buffer_.size();
+            buffer_.resize(have + std::max(scan_chunk, length));
+            auto n = ::read(fd_, buffer_.data() + have, buffer_.size() - have);
+            if (n < 0) {
+                throw io_error("read");
+            }
+            buffer_.resize(have + size_t(n));
+            if (n == 0) {
+                return false;
+            }
+        }
+        std::memcpy(res, buffer_.data() + position_, length);
+        position_ += length;
+        offset_ += length;
+        return true;
+    }
+
+    uint64_t offset() const {
+        return offset_;
+    }
+
+    // bytes left behind the current offset
+    uint64_t remaining() const {
+        return size_ > offset_ ? size_ - offset_ : 0;
+    }
+
+private:
+    int fd_;
+    uint64_t size_;
+    std::vector<char> buffer_;
+    size_t position_ = 0;
+    uint64_t offset_ = 0;
+};
+
+} // anonymous namespace
+
+namespace detail {
+
+log_file::log_file(const std::string& path, bool sync, io_engine& io)
+        : fd_(::open(path.c_str(), O_RDWR | O_CREAT, 0644)),
+          sync_(sync),
+          io_(io) {
+    if (fd_ < 0) {
+        throw io_error("open " + path);
+    }
+    auto size = ::lseek(fd_, 0, SEEK_END);
+    if (size < 0) {
+        throw io_error("lseek " + path);
+    }
+    end_ = written_end_ = uint64_t(size);
+}
+
+log_file::~log_file() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (write_in_progress_) {
+        written_.wait(lock);
+    }
+    if (!pending_.empty() && !error_) {
+        try {
+            write_group(lock);
+        } catch (std::system_error&) {
+        }
+    }
+    ::close(fd_);
+}
+
+uint64_t log_file::append(const char* header, size_t header_length, const char* data, size_t length, bool wait) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (error_) {
+        throw std::system_error(error_, "log write");
+    }
+    auto offset = end_;
+    pending_.insert(pending_.end(), header, header + header_length);
+    pending_.insert(pending_.end(), data, data + length);
+    end_ += header_length + length;
+    if (!wait) {
+        return offset;
+    }
+    while (written_end_ < offset + header_length + length) {
+        if (error_) {
+            throw std::system_error(error_, "log write");
+        }
+        if (write_in_progress_) {
+            written_.wait(lock);
+        } else {
+            write_group(lock);
+        }
+    }
+    return offset;
+}
+
+void log_file::write_group(std::unique_lock<std::mutex>& lock) {
+    write_in_progress_ = true;
+    writing_.swap(pending_);
+    auto offset = written_end_;
+    lock.unlock();
+    std::error_code ec;
+    for (size_t done = 0; done < writing_.size() && !ec;) {
+        auto n = io_.pwrite(fd_, writing_.data() + done, writing_.size() - done, offset + done);
+        if (n < 0 && errno != EINTR) {
+            ec = std::error_code(errno, std::system_category());
+        } else if (n > 0) {
+            done += size_t(n);
+        }
+    }
+    if (!ec && sync_ && io_.fdatasync(fd_) != 0) {
+        ec = std::error_code(errno, std::system_category());
+    }
+    lock.lock();
+    if (!ec) {
+        written_end_ = offset + writing_.size();
+    }
+    writing_.clear();
+    write_in_progress_ = false;
+    error_ = ec;
+    written_.notify_all();
+    if (ec) {
+        throw std::system_error(ec, "log write");
+    }
+}
+
+void log_file::read(uint64_t offset, char* buffer, size_t length) const {
+    for (size_t done = 0; done < length;) {
+        auto n = io_.pread(fd_, buffer + done, length - done, offset + done);
+        if (n < 0 && errno != EINTR) {
+            throw io_error("log read");
+        } else if (n == 0) {
+            throw std::system_error(make_error_code(std::errc::io_error), "log read past the end");
+        } else if (n > 0) {
+            done += size_t(n);
+        }
+    }
+}
+
+void log_file::truncate(uint64_t size) {
+    if (::ftruncate(fd_, off_t(size)) != 0) {
+        throw io_error("ftruncate");
+    }
+    end_ = written_end_ = size;
+}
+
+} // namespace detail
+
+file_node_table::file_node_table(const std::string& path, bool sync, io_engine& io)
+        : log_(path, sync, io),
+          counter_(0x0u) {
+    recover(path);
+}
+
+void file_node_table::recover(const std::string& path) {
+    file_scanner scanner(path);
+    uint64_t end = 0;
+    uint64_t max_pptr = 0;
+    node_record record;
+    std::vector<char> data;
+    while (scanner.next(reinterpret_cast<char*>(&record), sizeof(record))) {
+        if (record.length == tombstone_length) {
+            if (checksum(record, nullptr) != record.checksum) {
+                break;
+            }
+            index_.erase(record.pptr);
+        } else {
+            // a corrupt length must not make the scan allocate more than the file holds
+            if (record.length > scanner.remaining()) {
+                break;
+            }
+            data.resize(record.length);
+            if (!scanner.next(data.data(), record.length) || checksum(record, data.data()) != record.checksum) {
+                break;
+            }
+            index_[record.pptr] = location{end + sizeof(record), record.length};
+        }
+        max_pptr = std::max(max_pptr, record.pptr);
+        end = scanner.offset();
+    }
+    // a torn record at the end was never acknowledged
+    if (end != log_.size()) {
+        log_.truncate(end);
+    }
+    counter_ = max_pptr;
+}
+
+shared_node_data file_node_table::read(physical_pointer pptr, std::error_code& ec) {
+    location loc;
+    {
+        tbb::spin_rw_mutex::scoped_lock _(index_mutex_, false);
+        auto i = index_.find(pptr.value);
+        if (i == index_.end() || i->second.length == tombstone_length) {
+            ec = make_error_code(error::object_doesnt_exist);
+            return shared_node_data();
+        }
+        loc = i->second;
+    }
+    std::shared_ptr<char> data(new char[loc.length], std::default_delete<char[]>());
+    log_.read(loc.offset, data.get(), loc.length);
+    return shared_node_data(std::move(data), loc.length);
+}
+
+void file_node_table::insert(physical_pointer pptr, const char* data, size_t length, std::error_code& ec) {
+    if (length >= tombstone_length) {
+        throw std::length_error("node too large for the node log");
+    }
+    {
+        // the entry is reserved before the append so a losing duplicate insert leaves nothing in the log, until the
+        // record is written it reads as absent
+        tbb::spin_rw_mutex::scoped_lock _(index_mutex_, true);
+        if (!index_.emplace(pptr.value, location{0, tombstone_length}).second) {
+            ec = make_error_code(error::object_exists);
+            return;
+        }
+    }
+    node_record record{pptr.value, uint32_t(length), 0};
+    record.checksum = checksum(record, data);
+    uint64_t offset;
+    try {
+        offset = log_.append(reinterpret_cast<const char*>(&record), sizeof(record), data, length);
+    } catch (...) {
+        tbb::spin_rw_mutex::scoped_lock _(index_mutex_, true);
+        index_.erase(pptr.value);
+        throw;
+    }
+    tbb::spin_rw_mutex::scoped_lock _(index_mutex_, true);
+    index_[pptr.value] = location{offset + sizeof(record), uint32_t(length)};
+}
+
+void file_node_table::remove(physical_pointer pptr, std::error_code& ec) {
+    {
+        tbb::spin_rw_mutex::scoped_lock _(index_mutex_, true);
+        auto i = index_.find(pptr.value);
+        if (i == index_.end() || i->second.length == tombstone_length) {
+            ec = make_error_code(error::object_doesnt_exist);
+            return;
+        }
+        index_.erase(i);
+    }
+    // losing the tombstone in a crash only brings back an unreachable node, so it need not wait for the sync
+    node_record record{pptr.value, tombstone_length, 0};
+    record.checksum = checksum(record, nullptr);
+    log_.append(reinterpret_cast<const char*>(&record), sizeof(record), nullptr, 0, false);
+}
+
+file_ptr_table::file_ptr_table(const std::string& directory, const file_backend_config& config, io_engine& io)
+        : directory_(directory),
+          config_(config),
+          io_(io) {
+    recover();
+    checkpointer_ = std::thread([this]() {
+        run_checkpoints();
+    });
+}
+
+file_ptr_table::~file_ptr_table() {
+    {
+        std::lock_guard<std::mutex> _(checkpointer_mutex_);
+        stop_ = true;
+    }
+    checkpointer_wakeup_.notify_one();
+    checkpointer_.join();
+}
+
+void file_ptr_table::run_checkpoints() {
+    std::unique_lock<std::mutex> lock(checkpointer_mutex_);
+    for (;;) {
+        checkpointer_wakeup_.wait(lock, [this]() {
+            return stop_ || checkpoint_requested_;
+        });
+        if (stop_) {
+            return;
+        }
+        checkpoint_requested_ = false;
+        lock.unlock();
+        try {
+            checkpoint();
+        } catch (std::system_error&) {
+            // the logs are only dropped after the checkpoint is written, recovery replays them and the next request
+            // tries again
+        }
+        lock.lock();
+    }
+}
+
+void file_ptr_table::recover() {
+    // newest entry of every logical pointer, removed_version marks removed pointers
+    constexpr uint64_t removed_version = ~uint64_t(0);
+    std::unordered_map<uint64_t, checkpoint_entry> entries;
+    uint64_t counter = 0;
+    auto checkpoint_path = directory_ + "/ptr.checkpoint";
+    if (file_exists(checkpoint_path)) {
+        file_scanner scanner(checkpoint_path);
+        checkpoint_header header;
+        if (!scanner.next(reinterpret_cast<char*>(&header), sizeof(header))) {
+            throw std::system_error(make_error_code(std::errc::io_error), "truncated pointer table checkpoint");
+        }
+        uint32_t crc = 0;
+        checkpoint_entry entry;
+        for (uint64_t i = 0; i < header.entries; ++i) {
+            if (!scanner.next(reinterpret_cast<char*>(&entry), sizeof(entry))) {
+                throw std::system_error(make_error_code(std::errc::io_error), "truncated pointer table checkpoint");
+            }
+            crc = crc32(reinterpret_cast<const char*>(&entry), sizeof(entry), crc);
+            entries[entry.lptr] = entry;
+        }
+        if (crc != header.checksum) {
+            throw std::system_error(make_error_code(std::errc::io_error), "corrupt pointer table checkpoint");
+        }
+        first_log_seq_ = header.log_seq;
+        counter = header.counter;
+    }
+    auto seq = first_log_seq_;
+    for (; file_exists(log_path(directory_, seq)); ++seq) {
+        file_scanner scanner(log_path(directory_, seq));
+        ptr_record record;
+        while (scanner.next(reinterpret_cast<char*>(&record), sizeof(record)) && checksum(record) == record.checksum) {
+            counter = std::max(counter, record.lptr);
+            auto& entry = entries[record.lptr];
+            entry.lptr = record.lptr;
+            if (record.op == ptr_remove) {
+                entry.version = removed_version;
+            } else if (entry.version != removed_version && record.version > entry.version) {
+                entry.pptr = record.pptr;
+                entry.version = record.version;
+            }
+        }
+    }
+    if (counter != 0) {
+        table_.restore(logical_pointer{counter}, physical_pointer{0}, 0);
+    }
+    for (auto& e : entries) {
+        if (e.second.version != removed_version) {
+            table_.restore(logical_pointer{e.first}, physical_pointer{e.second.pptr}, e.second.version);
+        }
+    }
+    // fold the replayed logs into a new checkpoint
+    log_seq_ = seq;
+    log_ = std::make_shared<detail::log_file>(log_path(directory_, log_seq_), config_.sync, io_);
+    checkpoint();
+}
+
+std::shared_ptr<detail::log_file> file_ptr_table::current_log() {
+    std::lock_guard<std::mutex> _(log_mutex_);
+    return log_;
+}
+
+std::shared_ptr<detail::log_file> file_ptr_table::log(uint8_t op, logical_pointer lptr, physical_pointer pptr,
+        uint64_t version) {
+    ptr_record record;
+    std::memset(&record, 0, sizeof(record));
+    record.op = op;
+    record.lptr = lptr.value;
+    record.pptr = pptr.value;
+    record.version = version;
+    record.checksum = checksum(record);
+    auto log = current_log();
+    log->append(reinterpret_cast<const char*>(&record), sizeof(record), nullptr, 0);
+    if (++records_ == config_.checkpoint_interval) {
+        {
+            std::lock_guard<std::mutex> _(checkpointer_mutex_);
+            checkpoint_requested_ = true;
+        }
+        checkpointer_wakeup_.notify_one();
+    }
+    return log;
+}
+
+uint64_t file_ptr_table::insert(logical_pointer lptr, physical_pointer pptr, std::error_code& ec) {
+    if (lptr.value >= memory_ptr_table::capacity) {
+        throw std::length_error("logical pointer exceeds the capacity of the pointer table");
+    }
+    std::lock_guard<std::mutex> _(write_mutex(lptr));
+    std::error_code read_ec;
+    auto current = table_.read(lptr, read_ec);
+    if (!read_ec) {
+        ec = make_error_code(error::object_exists);
+        return std::get<1>(current);
+    }
+    // inserted pointers start at version 1
+    auto log = this->log(ptr_set, lptr, pptr, 1);
+    return table_.insert(lptr, pptr, ec);
+}
+
+uint64_t file_ptr_table::update(logical_pointer lptr, physical_pointer pptr, uint64_t version, std::error_code& ec) {
+    std::lock_guard<std::mutex> _(write_mutex(lptr));
+    auto current = table_.read(lptr, ec);
+    if (ec) {
+        return 0;
+    }
+    if (std::get<1>(current) > version) {
+        ec = make_error_code(error::wrong_version);
+        return std::get<1>(current);
+    }
+    auto log = this->log(ptr_set, lptr, pptr, std::get<1>(current) + 1);
+    return table_.update(lptr, pptr, version, ec);
+}
+
+void file_ptr_table::remove(logical_pointer lptr, uint64_t version, std::error_code& ec) {
+    std::lock_guard<std::mutex> _(write_mutex(lptr));
+    auto current = table_.read(lptr, ec);
+    if (ec) {
+        return;
+    }
+    if (std::get<1>(current) > version) {
+        ec = make_error_code(error::wrong_version);
+        return;
+    }
+    auto log = this->log(ptr_remove, lptr, physical_pointer{0}, 0);
+    table_.remove(lptr, version, ec);
+}
+
+void file_ptr_table::checkpoint() {
+    std::lock_guard<std::mutex> _(checkpoint_mutex_);
+    // changes logged from now on go to the new log, the ones in the old log are in the table once their writers
+    // let go of it
+    uint64_t seq;
+    std::shared_ptr<detail::log_file> old_log;
+    {
+        std::lock_guard<std::mutex> _(log_mutex_);
+        seq = log_seq_ + 1;
+        auto next = std::make_shared<detail::log_file>(log_path(directory_, seq), config_.sync, io_);
+        log_seq_ = seq;
+        old_log = std::move(log_);
+        log_ = std::move(next);
+    }
+    records_ = 0;
+    while (old_log.use_count() > 1) {
+        std::this_thread::yield();
+    }
+    old_log.reset();
+
+    checkpoint_header header;
+    header.log_seq = seq;
+    header.counter = table_.get_remote_ptr().value;
+    std::vector<checkpoint_entry> entries;
+    for (uint64_t lptr = 1; lptr <= header.counter; ++lptr) {
+        std::error_code ec;
+        auto e = table_.read(logical_pointer{lptr}, ec);
+        if (!ec) {
+            entries.push_back(checkpoint_entry{lptr, std::get<0>(e).value, std::get<1>(e)});
+        }
+    }
+    header.entries = entries.size();
+    header.checksum = crc32(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(checkpoint_entry));
+
+    auto path = directory_ + "/ptr.checkpoint";
+    {
+        detail::log_file file(path + ".tmp", true, io_);
+        file.truncate(0);
+        file.append(reinterpret_cast<const char*>(&header), sizeof(header),
+                reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(checkpoint_entry));
+    }
+    if (::rename((path + ".tmp").c_str(), path.c_str()) != 0) {
+        throw io_error("rename " + path);
+    }
+    sync_directory(directory_);
+    for (; first_log_seq_ < seq; ++first_log_seq_) {
+        ::unlink(log_path(directory_, first_log_seq_).c_str());
+    }
+}
+
+file_backend::file_backend(const std::string& directory, const file_backend_config& config)
+        : io_(config.io_queue_depth, config.io_registered_buffers, config.io_buffer_size),
+          node_(create_directory(directory) + "/nodes.log", config.sync, io_),
+          ptr_(directory, config, io_) {
+}
+
+const std::string& file_backend::create_directory(const std::string& directory) {
+    if (::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw io_error("mkdir " + directory);
+    }
+    return directory;
+}
+
+} // namespace bdtree
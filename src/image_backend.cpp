@@ -0,0 +1,101 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include <bdtree/image_backend.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bdtree {
+
+namespace {
+
+std::system_error corrupt_image(const std::string& what) {
+    return std::system_error(std::make_error_code(std::errc::io_error), what);
+}
+
+const detail::image_header& header_of(const detail::mapped_file& file) {
+    return *reinterpret_cast<const detail::image_header*>(file.data().get());
+}
+
+const detail::image_entry* table_of(const detail::mapped_file& file) {
+    return reinterpret_cast<const detail::image_entry*>(file.data().get() + header_of(file).table_offset);
+}
+
+} // anonymous namespace
+
+namespace detail {
+
+mapped_file::mapped_file(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error(errno, std::system_category(), "open " + path);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::system_error(errno, std::system_category(), "stat " + path);
+    }
+    size_ = size_t(st.st_size);
+    if (size_ < sizeof(image_header)) {
+        ::close(fd);
+        throw corrupt_image(path + " is not a tree image");
+    }
+    auto addr = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        throw std::system_error(errno, std::system_category(), "mmap " + path);
+    }
+    auto size = size_;
+    data_ = std::shared_ptr<const char>(static_cast<const char*>(addr), [size](const char* p) {
+        ::munmap(const_cast<char*>(p), size);
+    });
+
+    auto& header = header_of(*this);
+    if (header.magic != image_magic || header.table_offset > size_
+            || (size_ - header.table_offset) / sizeof(image_entry) <= header.max_lptr) {
+        throw corrupt_image(path + " is not a tree image");
+    }
+}
+
+} // namespace detail
+
+image_ptr_table::image_ptr_table(const detail::mapped_file& file)
+        : table_(table_of(file)),
+          max_lptr_(header_of(file).max_lptr) {
+}
+
+image_node_table::image_node_table(const detail::mapped_file& file)
+        : data_(file.data()),
+          table_(table_of(file)),
+          max_lptr_(header_of(file).max_lptr) {
+}
+
+image_backend::image_backend(const std::string& path)
+        : file_(path),
+          ptr_(file_),
+          node_(file_) {
+}
+
+} // namespace bdtree
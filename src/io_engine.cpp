@@ -0,0 +1,374 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include <bdtree/io_engine.h>
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define BDTREE_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+namespace bdtree {
+
+namespace {
+
+enum class io_op : uint8_t {
+    read,
+    write,
+    sync
+};
+
+uint64_t now_ns() {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void update_max(std::atomic<uint64_t>& max, uint64_t value) {
+    auto current = max.load();
+    while (current < value && !max.compare_exchange_weak(current, value)) {
+    }
+}
+
+} // anonymous namespace
+
+struct io_engine::request {
+    io_op op;
+    int fd;
+    char* buffer;
+    size_t length;
+    uint64_t offset;
+    int buffer_index = -1;
+    uint64_t start = 0;
+    ssize_t result = 0;
+    bool done = false;
+
+    request(io_op op, int fd, char* buffer, size_t length, uint64_t offset)
+            : op(op), fd(fd), buffer(buffer), length(length), offset(offset) {
+    }
+};
+
+#ifdef BDTREE_HAVE_IO_URING
+
+struct io_engine::ring {
+    int fd = -1;
+    unsigned entries = 0;
+
+    void* sq_map = MAP_FAILED;
+    size_t sq_map_size = 0;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned* sq_array;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqes_size = 0;
+
+    void* cq_map = MAP_FAILED;
+    size_t cq_map_size = 0;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe* cqes;
+
+    size_t buffer_size = 0;
+    std::vector<std::unique_ptr<char[]>> buffers;
+    std::vector<int> free_buffers;
+
+    std::mutex mutex;
+    std::condition_variable completed;
+    std::deque<request*> queued;
+    unsigned in_flight = 0;
+    bool submitting = false;
+    bool waiting = false;
+
+    ~ring() {
+        if (sqes != MAP_FAILED) {
+            ::munmap(sqes, sqes_size);
+        }
+        if (cq_map != MAP_FAILED) {
+            ::munmap(cq_map, cq_map_size);
+        }
+        if (sq_map != MAP_FAILED) {
+            ::munmap(sq_map, sq_map_size);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    bool setup(unsigned depth) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd = int(::syscall(__NR_io_uring_setup, depth, &params));
+        if (fd < 0) {
+            return false;
+        }
+        entries = params.sq_entries;
+        sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        sq_map = ::mmap(nullptr, sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        cq_map = ::mmap(nullptr, cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                fd, IORING_OFF_SQES));
+        if (sq_map == MAP_FAILED || cq_map == MAP_FAILED || sqes == MAP_FAILED) {
+            return false;
+        }
+        auto sq = static_cast<char*>(sq_map);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        auto cq = static_cast<char*>(cq_map);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // registering can fail, e.g. on a low memlock limit, the ring then works without
+    void register_buffers(unsigned count, size_t size) {
+        std::vector<iovec> iovecs;
+        for (unsigned i = 0; i < count; ++i) {
+            buffers.emplace_back(new char[size]);
+            iovecs.push_back(iovec{buffers.back().get(), size});
+        }
+        if (count == 0 || ::syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iovecs.data(), count) != 0) {
+            buffers.clear();
+            return;
+        }
+        buffer_size = size;
+        for (unsigned i = 0; i < count; ++i) {
+            free_buffers.push_back(int(i));
+        }
+    }
+
+    void prepare(request& r) {
+        auto tail = *sq_tail;
+        auto index = tail & sq_mask;
+        auto& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.fd = r.fd;
+        sqe.user_data = reinterpret_cast<uint64_t>(&r);
+        if (r.op == io_op::sync) {
+            sqe.opcode = IORING_OP_FSYNC;
+            sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+        } else {
+            bool fixed = r.buffer_index >= 0;
+            sqe.opcode = r.op == io_op::read ? (fixed ? IORING_OP_READ_FIXED : IORING_OP_READ)
+                                             : (fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE);
+            sqe.addr = reinterpret_cast<uint64_t>(fixed ? buffers[r.buffer_index].get() : r.buffer);
+            sqe.len = uint32_t(r.length);
+            sqe.off = r.offset;
+            if (fixed) {
+                sqe.buf_index = uint16_t(r.buffer_index);
+            }
+        }
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    // prepared entries the kernel has not consumed yet
+    unsigned unsubmitted() const {
+        return *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    }
+
+    // returns the latency of every reaped request to the callback
+    template <typename F>
+    void reap(F f) {
+        auto head = *cq_head;
+        auto tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            auto& cqe = cqes[head & cq_mask];
+            auto r = reinterpret_cast<request*>(cqe.user_data);
+            r->result = cqe.res;
+            r->done = true;
+            --in_flight;
+            f(*r);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+};
+
+io_engine::io_engine(unsigned queue_depth, unsigned registered_buffers, size_t buffer_size) {
+    if (queue_depth == 0) {
+        return;
+    }
+    std::unique_ptr<ring> r(new ring());
+    if (r->setup(queue_depth)) {
+        r->register_buffers(registered_buffers, buffer_size);
+        ring_ = std::move(r);
+    }
+}
+
+ssize_t io_engine::execute(request& r) {
+    r.start = now_ns();
+    if (!ring_) {
+        return execute_blocking(r);
+    }
+    auto& ring = *ring_;
+    std::unique_lock<std::mutex> lock(ring.mutex);
+    if (r.op != io_op::sync && r.length <= ring.buffer_size && !ring.free_buffers.empty()) {
+        r.buffer_index = ring.free_buffers.back();
+        ring.free_buffers.pop_back();
+        if (r.op == io_op::write) {
+            std::memcpy(ring.buffers[r.buffer_index].get(), r.buffer, r.length);
+        }
+    }
+    ring.queued.push_back(&r);
+    // one thread at a time submits everything queued, one thread at a time waits for completions; requests
+    // queued while a submission is in progress go out with the next one
+    while (!r.done) {
+        if (!ring.submitting && !ring.queued.empty() && ring.in_flight < ring.entries) {
+            ring.submitting = true;
+            while (!ring.queued.empty() && ring.in_flight < ring.entries) {
+                ring.prepare(*ring.queued.front());
+                ring.queued.pop_front();
+                ++ring.in_flight;
+            }
+            update_max(max_queue_depth_, ring.in_flight);
+            auto to_submit = ring.unsubmitted();
+            lock.unlock();
+            // failures of single requests come back in their completion, the call itself only fails transiently
+            // (EINTR, EAGAIN, EBUSY) or submits only a part; the waiter picks up whatever is left in the ring
+            if (::syscall(__NR_io_uring_enter, ring.fd, to_submit, 0, 0, nullptr, 0) > 0) {
+                ++batches_;
+            }
+            lock.lock();
+            ring.submitting = false;
+            ring.completed.notify_all();
+        } else if (!ring.waiting && ring.in_flight > 0) {
+            ring.waiting = true;
+            // entries a failed or partial submission left behind would otherwise never reach the kernel
+            auto to_submit = ring.unsubmitted();
+            lock.unlock();
+            if (::syscall(__NR_io_uring_enter, ring.fd, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0) > 0
+                    && to_submit > 0) {
+                ++batches_;
+            }
+            lock.lock();
+            ring.reap([this](request& done) {
+                auto latency = now_ns() - done.start;
+                total_latency_ns_ += latency;
+                update_max(max_latency_ns_, latency);
+                ++requests_;
+            });
+            ring.waiting = false;
+            ring.completed.notify_all();
+        } else {
+            ring.completed.wait(lock);
+        }
+    }
+    if (r.buffer_index >= 0) {
+        if (r.op == io_op::read && r.result > 0) {
+            std::memcpy(r.buffer, ring.buffers[r.buffer_index].get(), size_t(r.result));
+        }
+        ring.free_buffers.push_back(r.buffer_index);
+    }
+    if (r.result < 0) {
+        errno = int(-r.result);
+        return -1;
+    }
+    return r.result;
+}
+
+#else
+
+struct io_engine::ring {
+};
+
+io_engine::io_engine(unsigned, unsigned, size_t) {
+}
+
+ssize_t io_engine::execute(request& r) {
+    r.start = now_ns();
+    return execute_blocking(r);
+}
+
+#endif
+
+io_engine::~io_engine() = default;
+
+ssize_t io_engine::execute_blocking(request& r) {
+    update_max(max_queue_depth_, ++queue_depth_);
+    ssize_t res;
+    switch (r.op) {
+    case io_op::read:
+        res = ::pread(r.fd, r.buffer, r.length, off_t(r.offset));
+        break;
+    case io_op::write:
+        res = ::pwrite(r.fd, r.buffer, r.length, off_t(r.offset));
+        break;
+    default:
+        res = ::fdatasync(r.fd);
+        break;
+    }
+    --queue_depth_;
+    auto latency = now_ns() - r.start;
+    total_latency_ns_ += latency;
+    update_max(max_latency_ns_, latency);
+    ++requests_;
+    ++batches_;
+    return res;
+}
+
+ssize_t io_engine::pread(int fd, char* buffer, size_t length, uint64_t offset) {
+    request r{io_op::read, fd, buffer, length, offset};
+    return execute(r);
+}
+
+ssize_t io_engine::pwrite(int fd, const char* buffer, size_t length, uint64_t offset) {
+    request r{io_op::write, fd, const_cast<char*>(buffer), length, offset};
+    return execute(r);
+}
+
+int io_engine::fdatasync(int fd) {
+    request r{io_op::sync, fd, nullptr, 0, 0};
+    return int(execute(r));
+}
+
+io_statistics io_engine::statistics() const {
+    io_statistics res;
+    res.requests = requests_.load();
+    res.batches = batches_.load();
+    res.max_queue_depth = max_queue_depth_.load();
+    res.total_latency_ns = total_latency_ns_.load();
+    res.max_latency_ns = max_latency_ns_.load();
+    return res;
+}
+
+} // namespace bdtree
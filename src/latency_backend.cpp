@@ -0,0 +1,132 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include <bdtree/latency_backend.h>
+
+#include <algorithm>
+#include <thread>
+
+namespace bdtree {
+
+namespace {
+
+uint64_t now_ns() {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            detail::latency_model::clock::now().time_since_epoch()).count());
+}
+
+std::mt19937_64& thread_random(uint64_t seed) {
+    static std::atomic<uint64_t> threads{0};
+    thread_local std::mt19937_64 random(seed + threads.fetch_add(1));
+    return random;
+}
+
+void wait_until(uint64_t deadline_ns, uint64_t spin_threshold_ns) {
+    auto now = now_ns();
+    if (deadline_ns > now + spin_threshold_ns) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(deadline_ns - now - spin_threshold_ns));
+    }
+    while (now_ns() < deadline_ns) {
+        std::this_thread::yield();
+    }
+}
+
+} // anonymous namespace
+
+uint64_t latency_distribution::sample(std::mt19937_64& random) const {
+    switch (kind_) {
+    case kind::constant:
+        return a_;
+    case kind::uniform:
+        return a_ >= b_ ? a_ : std::uniform_int_distribution<uint64_t>(a_, b_)(random);
+    case kind::exponential:
+        return b_ <= a_ ? a_ : a_ + uint64_t(std::exponential_distribution<double>(1.0 / double(b_ - a_))(random));
+    }
+    return 0;
+}
+
+namespace detail {
+
+latency_model::pending_call latency_model::begin(backend_call call, size_t request_length) {
+    pending_call res;
+    res.call = call;
+    res.start = clock::now();
+    res.latency_ns = config_.latency[size_t(call)].sample(thread_random(config_.seed));
+    res.delay_ns = delay(res.latency_ns / 2, request_length, to_backend_);
+    return res;
+}
+
+void latency_model::end(pending_call& pending, const backend_call_info& info) {
+    pending.delay_ns += delay(pending.latency_ns - pending.latency_ns / 2, info.response_length, from_backend_);
+    auto& c = counters_[size_t(pending.call)];
+    c.calls.fetch_add(1, std::memory_order_relaxed);
+    if (info.ec) {
+        c.errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    c.bytes.fetch_add(info.request_length + info.response_length, std::memory_order_relaxed);
+    c.delay_ns.fetch_add(pending.delay_ns, std::memory_order_relaxed);
+    c.total_ns.fetch_add(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            clock::now() - pending.start).count()), std::memory_order_relaxed);
+}
+
+uint64_t latency_model::delay(uint64_t latency_ns, size_t length, std::atomic<uint64_t>& link) {
+    if (latency_ns == 0 && (config_.bandwidth == 0 || length == 0)) {
+        return 0;
+    }
+    auto start = now_ns();
+    auto deadline = start + latency_ns;
+    if (config_.bandwidth != 0 && length != 0) {
+        auto transfer_ns = uint64_t(double(length) * 1e9 / double(config_.bandwidth));
+        auto busy = link.load();
+        uint64_t done;
+        do {
+            done = std::max(busy, start) + transfer_ns;
+        } while (!link.compare_exchange_weak(busy, done));
+        deadline = std::max(deadline, done);
+    }
+    wait_until(deadline, config_.spin_threshold_ns);
+    return now_ns() - start;
+}
+
+call_statistics latency_model::statistics(backend_call call) const {
+    auto& c = counters_[size_t(call)];
+    call_statistics res;
+    res.calls = c.calls.load();
+    res.errors = c.errors.load();
+    res.bytes = c.bytes.load();
+    res.delay_ns = c.delay_ns.load();
+    res.total_ns = c.total_ns.load();
+    return res;
+}
+
+void latency_model::reset_statistics() {
+    for (auto& c : counters_) {
+        c.calls.store(0);
+        c.errors.store(0);
+        c.bytes.store(0);
+        c.delay_ns.store(0);
+        c.total_ns.store(0);
+    }
+}
+
+} // namespace detail
+} // namespace bdtree
@@ -0,0 +1,64 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include <bdtree/pointer_lease.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace bdtree {
+namespace detail {
+
+namespace {
+
+// direct mapped by owner id, the pointer and the node table of a backend get consecutive ids
+constexpr size_t lease_cache_size = 8;
+
+std::atomic<uint64_t> lease_owners(0);
+
+// trivial so that the thread local needs no initialization, it starts zeroed and owner ids start at 1
+struct cached_lease {
+    uint64_t owner;
+    pointer_lease* lease;
+};
+
+thread_local std::array<cached_lease, lease_cache_size> lease_cache;
+
+} // anonymous namespace
+
+uint64_t new_lease_owner() {
+    return ++lease_owners;
+}
+
+pointer_lease& thread_lease(uint64_t owner, tbb::enumerable_thread_specific<pointer_lease>& leases) {
+    auto& cached = lease_cache[owner % lease_cache_size];
+    if (cached.owner != owner) {
+        // elements of an enumerable_thread_specific do not move, and ids of destroyed tables never come back
+        cached.owner = owner;
+        cached.lease = &leases.local();
+    }
+    return *cached.lease;
+}
+
+} // namespace detail
+} // namespace bdtree
@@ -0,0 +1,65 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include <bdtree/serialize_buffer.h>
+
+#include <memory>
+
+namespace bdtree {
+
+namespace {
+
+// buffers grown beyond this by a large value are freed instead of being kept
+constexpr size_t max_pooled_capacity = 64 * 1024;
+constexpr size_t max_pooled_buffers = 8;
+
+struct buffer_pool {
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> buffers;
+
+    buffer_pool() {
+        buffers.reserve(max_pooled_buffers);
+    }
+};
+
+thread_local buffer_pool pool;
+
+} // anonymous namespace
+
+std::vector<uint8_t>* serialize_buffer::acquire() {
+    if (pool.buffers.empty()) {
+        return new std::vector<uint8_t>();
+    }
+    auto res = pool.buffers.back().release();
+    pool.buffers.pop_back();
+    return res;
+}
+
+void serialize_buffer::release(std::vector<uint8_t>* buffer) {
+    if (pool.buffers.size() == max_pooled_buffers || buffer->capacity() > max_pooled_capacity) {
+        delete buffer;
+        return;
+    }
+    buffer->clear();
+    pool.buffers.emplace_back(buffer);
+}
+
+} // namespace bdtree
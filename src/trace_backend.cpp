@@ -0,0 +1,225 @@
+/*
+ * (C) Copyright 2015 ETH Zurich Systems Group (http://www.systems.ethz.ch/) and others.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *     Markus Pilman <mpilman@inf.ethz.ch>
+ *     Simon Loesing <sloesing@inf.ethz.ch>
+ *     Thomas Etter <etterth@gmail.com>
+ *     Kevin Bocksrocker <kevin.bocksrocker@gmail.com>
+ *     Lucas Braun <braunl@inf.ethz.ch>
+ */
+#include <bdtree/trace_backend.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace bdtree {
+
+namespace {
+
+constexpr size_t batch_records = 4096;
+
+std::system_error io_error(const std::string& what) {
+    return std::system_error(errno, std::system_category(), what);
+}
+
+uint64_t next_writer_id() {
+    static std::atomic<uint64_t> writers{0};
+    return writers.fetch_add(1);
+}
+
+uint16_t thread_number() {
+    static std::atomic<uint16_t> threads{0};
+    thread_local uint16_t number = threads.fetch_add(1);
+    return number;
+}
+
+void write_all(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        auto res = ::write(fd, data, length);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw io_error("trace write");
+        }
+        data += res;
+        length -= size_t(res);
+    }
+}
+
+} // anonymous namespace
+
+namespace detail {
+
+uint8_t trace_error(const std::error_code& ec) {
+    if (!ec) {
+        return 0;
+    }
+    if (ec.category() == error::get_backend_category() && ec.value() > 0 && ec.value() < 0xff) {
+        return uint8_t(ec.value());
+    }
+    return 0xff;
+}
+
+trace_writer::trace_writer(const std::string& path)
+        : fd_(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)),
+          start_(clock::now()),
+          id_(next_writer_id()) {
+    if (fd_ < 0) {
+        throw io_error("open " + path);
+    }
+    trace_file_header header{trace_magic, sizeof(trace_record)};
+    try {
+        write_all(fd_, reinterpret_cast<const char*>(&header), sizeof(header));
+    } catch (...) {
+        ::close(fd_);
+        throw;
+    }
+}
+
+trace_writer::~trace_writer() {
+    try {
+        flush();
+    } catch (std::system_error&) {
+        // the trace is cut short, readers ignore a partial last record
+    }
+    ::close(fd_);
+}
+
+void trace_writer::end(pending_call& pending, const backend_call_info& info) {
+    auto now = clock::now();
+    trace_record record;
+    record.start_ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(pending.start - start_).count());
+    auto duration = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now - pending.start).count());
+    record.duration_ns = uint32_t(std::min<uint64_t>(duration, std::numeric_limits<uint32_t>::max()));
+    record.thread = thread_number();
+    record.call = uint8_t(info.call);
+    record.error = trace_error(info.ec);
+    record.ptr = info.ptr;
+    record.value = info.value;
+    record.version = info.version;
+
+    auto& buffer = local_buffer();
+    std::vector<trace_record> full;
+    {
+        std::lock_guard<std::mutex> _(buffer.mutex);
+        buffer.records.push_back(record);
+        ++buffer.count;
+        if (buffer.records.size() < batch_records) {
+            return;
+        }
+        full.reserve(batch_records);
+        full.swap(buffer.records);
+    }
+    write(full);
+}
+
+trace_writer::thread_buffer& trace_writer::local_buffer() {
+    // writer ids are never reused, so entries of destroyed writers are never looked up again
+    thread_local std::unordered_map<uint64_t, thread_buffer*> buffers;
+    auto& buffer = buffers[id_];
+    if (buffer == nullptr) {
+        std::unique_ptr<thread_buffer> created(new thread_buffer());
+        created->records.reserve(batch_records);
+        buffer = created.get();
+        std::lock_guard<std::mutex> _(mutex_);
+        buffers_.push_back(std::move(created));
+    }
+    return *buffer;
+}
+
+void trace_writer::flush() {
+    std::lock_guard<std::mutex> _(mutex_);
+    for (auto& buffer : buffers_) {
+        std::vector<trace_record> pending;
+        {
+            std::lock_guard<std::mutex> _(buffer->mutex);
+            pending.swap(buffer->records);
+            buffer->records.reserve(batch_records);
+        }
+        write(pending);
+    }
+}
+
+uint64_t trace_writer::records() const {
+    std::lock_guard<std::mutex> _(mutex_);
+    uint64_t res = 0;
+    for (auto& buffer : buffers_) {
+        std::lock_guard<std::mutex> _(buffer->mutex);
+        res += buffer->count;
+    }
+    return res;
+}
+
+void trace_writer::write(const std::vector<trace_record>& records) {
+    std::lock_guard<std::mutex> _(write_mutex_);
+    write_all(fd_, reinterpret_cast<const char*>(records.data()), records.size() * sizeof(trace_record));
+}
+
+} // namespace detail
+
+std::vector<trace_record> read_trace(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw io_error("open " + path);
+    }
+    std::vector<char> data;
+    char chunk[1 << 16];
+    for (;;) {
+        auto res = ::read(fd, chunk, sizeof(chunk));
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            auto err = io_error("read " + path);
+            ::close(fd);
+            throw err;
+        }
+        if (res == 0) {
+            break;
+        }
+        data.insert(data.end(), chunk, chunk + res);
+    }
+    ::close(fd);
+
+    detail::trace_file_header header;
+    if (data.size() < sizeof(header)) {
+        throw std::system_error(std::make_error_code(std::errc::io_error), path + " is not a trace");
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != detail::trace_magic || header.record_length != sizeof(trace_record)) {
+        throw std::system_error(std::make_error_code(std::errc::io_error), path + " is not a trace");
+    }
+    std::vector<trace_record> records((data.size() - sizeof(header)) / sizeof(trace_record));
+    std::memcpy(records.data(), data.data() + sizeof(header), records.size() * sizeof(trace_record));
+    for (auto& record : records) {
+        if (record.call >= num_backend_calls) {
+            throw std::system_error(std::make_error_code(std::errc::io_error), path + " has an invalid record");
+        }
+    }
+    std::stable_sort(records.begin(), records.end(), [](const trace_record& a, const trace_record& b) {
+        return a.start_ns < b.start_ns;
+    });
+    return records;
+}
+
+} // namespace bdtree
@@ -33,25 +33,10 @@
 
 #include <atomic>
 #include <cstdint>
+#include <memory>
 #include <vector>
 
-class dummy_node_data {
-public:
-    dummy_node_data(const std::vector<char>& data)
-            : data_(data) {
-    }
-
-    const char* data() const {
-        return data_.data();
-    }
-
-    size_t length() const {
-        return data_.size();
-    }
-
-private:
-    std::vector<char> data_;
-};
+using dummy_node_data = bdtree::shared_node_data;
 
 class dummy_ptr_table : public bdtree::base_ptr_table<dummy_ptr_table> {
 public:
@@ -63,6 +48,10 @@ public:
         return {++counter_};
     }
 
+    bdtree::logical_pointer reserve_ptrs(uint64_t count) {
+        return {counter_.fetch_add(count) + 1};
+    }
+
     bdtree::logical_pointer get_remote_ptr() {
         return {counter_.load()};
     }
@@ -145,6 +134,10 @@ public:
         return {++counter_};
     }
 
+    bdtree::physical_pointer reserve_ptrs(uint64_t count) {
+        return {counter_.fetch_add(count) + 1};
+    }
+
     bdtree::physical_pointer get_remote_ptr() {
         return {counter_.load()};
     }
@@ -154,7 +147,7 @@ public:
         auto i = nodes_.find(pptr);
         if (i == nodes_.end()) {
             ec = make_error_code(bdtree::error::object_doesnt_exist);
-            return dummy_node_data(std::vector<char>());
+            return dummy_node_data();
         }
         return dummy_node_data(i->second);
     }
@@ -163,7 +156,7 @@ public:
 
     void insert(bdtree::physical_pointer pptr, const char* data, size_t length, std::error_code& ec) {
         typename decltype(nodes_mutex_)::scoped_lock _(nodes_mutex_, false);
-        auto res = nodes_.insert(std::make_pair(pptr, std::vector<char>(data, data + length)));
+        auto res = nodes_.insert(std::make_pair(pptr, std::make_shared<const std::vector<char>>(data, data + length)));
         if (!res.second) {
             ec = make_error_code(bdtree::error::object_exists);
         }
@@ -187,8 +180,8 @@ private:
     std::atomic<uint64_t> counter_;
 
     tbb::spin_rw_mutex nodes_mutex_;
-    tbb::concurrent_unordered_map<bdtree::physical_pointer, std::vector<char>, std::hash<bdtree::physical_pointer>>
-            nodes_;
+    tbb::concurrent_unordered_map<bdtree::physical_pointer, std::shared_ptr<const std::vector<char>>,
+            std::hash<bdtree::physical_pointer>> nodes_;
 };
 
 class dummy_backend : crossbow::non_copyable, crossbow::non_movable {
@@ -21,15 +21,87 @@
  *     Lucas Braun <braunl@inf.ethz.ch>
  */
 #include <bdtree/bdtree.h>
+#include <bdtree/file_backend.h>
+#include <bdtree/image_backend.h>
+#include <bdtree/latency_backend.h>
+#include <bdtree/memory_backend.h>
+#include <bdtree/trace_backend.h>
 
 #include "dummy_backend.hpp"
 
 #include <crossbow/allocator.hpp>
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <limits>
 #include <thread>
 #include <random>
 
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bdtree {
+
+// exercise the bit-packed leaf layout with the signed key tree
+template<>
+struct node_format_traits<int64_t, uint64_t> {
+    static constexpr uint8_t flags = node_format::defaults | node_format::packed_keys;
+};
+
+// exercise the split value layout with the string value tree
+template<>
+struct node_format_traits<uint32_t, std::string> {
+    static constexpr uint8_t flags = node_format::defaults | node_format::split_values;
+};
+
+}
+
+// a key with only four distinct hashes, all entries of a leaf share their hash tag with many others
+struct colliding_key {
+    uint64_t value;
+    bool operator== (const colliding_key& other) const { return value == other.value; }
+};
+
+namespace std {
+
+template<>
+struct hash<colliding_key> {
+    size_t operator() (const colliding_key& key) const { return key.value % 4; }
+};
+
+}
+
+// compares the interpolating key bounds with the std algorithms for the keys themselves, their neighbours and the extremes
+template<typename Key>
+void check_key_bounds(std::vector<Key> keys) {
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    std::vector<std::pair<Key, uint64_t>> entries;
+    for (auto key : keys) {
+        entries.emplace_back(key, 0);
+    }
+    std::vector<Key> probes{std::numeric_limits<Key>::min(), std::numeric_limits<Key>::max()};
+    for (auto key : keys) {
+        probes.push_back(key);
+        if (key != std::numeric_limits<Key>::min()) {
+            probes.push_back(key - 1);
+        }
+        if (key != std::numeric_limits<Key>::max()) {
+            probes.push_back(key + 1);
+        }
+    }
+    bdtree::key_compare<Key, uint64_t> cmp;
+    for (auto probe : probes) {
+        assert(bdtree::key_lower_bound(entries.begin(), entries.end(), probe, cmp)
+                == std::lower_bound(entries.begin(), entries.end(), probe, cmp));
+        assert(bdtree::key_upper_bound(entries.begin(), entries.end(), probe, cmp)
+                == std::upper_bound(entries.begin(), entries.end(), probe, cmp));
+    }
+}
+
 uint8_t* rc_alloc_fun(size_t s) { return new uint8_t[s]; }
 void rc_dealloc_fun(uint8_t* b) { delete[] b; }
 
@@ -159,6 +231,844 @@ int main() {
         }
     }
 
+    alloc.reset(new crossbow::allocator());
+    {
+        // test normalized composite keys
+        typedef std::tuple<int64_t, std::string> composite_key;
+        std::vector<composite_key> keys;
+        for (int64_t i = -500; i < 500; ++i) {
+            std::string str(size_t(i % 7 + 7), 'a');
+            str.push_back('\0');
+            str += std::to_string(i);
+            keys.emplace_back(i / 10, str);
+        }
+        dummy_backend nbackend;
+        bdtree::logical_table_cache<bdtree::normalized_key, uint64_t, dummy_backend> ncache;
+        bdtree::map<bdtree::normalized_key, uint64_t, dummy_backend> nmap(nbackend, ncache, bdtree::get_next_tx_id(),
+                true);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto inserted = nmap.insert(bdtree::normalize(keys[i]), i);
+            assert(inserted);
+        }
+        std::sort(keys.begin(), keys.end());
+        auto iter = nmap.find(bdtree::null_key<bdtree::normalized_key>::value());
+        for (auto& key : keys) {
+            assert(iter != nmap.end());
+            assert(bdtree::denormalize<composite_key>(iter->first) == key);
+            ++iter;
+        }
+        assert(iter == nmap.end());
+        // keys that compare equal encode equally
+        assert(bdtree::normalize(-0.0) == bdtree::normalize(0.0));
+        auto nan = bdtree::normalize(std::numeric_limits<double>::quiet_NaN());
+        assert(bdtree::normalize(-std::numeric_limits<double>::quiet_NaN()) == nan);
+        assert(bdtree::normalize(std::numeric_limits<float>::signaling_NaN()) ==
+                bdtree::normalize(std::numeric_limits<float>::quiet_NaN()));
+        assert(bdtree::normalize(std::numeric_limits<double>::infinity()) < nan);
+    }
+
+    alloc.reset(new crossbow::allocator());
+    {
+        // test string keys with long shared prefixes: leaves split and merge at truncated separators
+        std::vector<std::string> keys;
+        for (int i = 0; i < 3000; ++i) {
+            auto number = std::to_string(1000000 + i * 3);
+            keys.push_back("https://example.org/" + std::string(200, 'p') + "/" + number + "/" + std::string(60, 't'));
+        }
+        auto full_length = keys.front().size();
+        std::vector<std::string> shuffled = keys;
+        std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(7));
+        dummy_backend tbackend;
+        bdtree::logical_table_cache<std::string, uint64_t, dummy_backend> tcache;
+        bdtree::map<std::string, uint64_t, dummy_backend> tmap(tbackend, tcache, bdtree::get_next_tx_id(), true);
+        for (auto& key : shuffled) {
+            auto inserted = tmap.insert(key, key.size());
+            assert(inserted);
+        }
+        // counts the leaves through the entries of the inner nodes just above them
+        auto leaves = [&tbackend, &tcache]() {
+            bdtree::operation_context<std::string, uint64_t, dummy_backend> context{tbackend, tcache,
+                    bdtree::get_next_tx_id()};
+            auto np = context.get_without_cache(bdtree::logical_pointer{1});
+            assert(np->node_->get_node_type() == bdtree::node_type_t::InnerNode);
+            while (np->as_inner()->level > 1) {
+                np = context.get_without_cache(np->as_inner()->array_.front().second);
+            }
+            size_t count = 0;
+            for (;;) {
+                count += np->as_inner()->array_.size();
+                if (!np->as_inner()->high_key_) {
+                    return count;
+                }
+                np = context.get_without_cache(np->as_inner()->right_link_);
+            }
+        };
+        assert(leaves() > 10);
+        bdtree::operation_context<std::string, uint64_t, dummy_backend> tcontext{tbackend, tcache,
+                bdtree::get_next_tx_id()};
+        auto root = tcontext.get_without_cache(bdtree::logical_pointer{1});
+        for (auto& e : root->as_inner()->array_) {
+            assert(e.first.size() < full_length);
+        }
+        // lookups for the keys, their prefixes up to the separator length and just past them land on the next key
+        auto check = [&tmap, &keys, full_length](const std::vector<std::string>& present) {
+            for (auto& key : keys) {
+                for (auto probe : {key, key.substr(0, full_length - 61), key + "\x01"}) {
+                    auto expected = std::lower_bound(present.begin(), present.end(), probe);
+                    auto iter = tmap.find(probe);
+                    assert(expected == present.end() ? iter == tmap.end()
+                                                     : iter != tmap.end() && iter->first == *expected);
+                }
+            }
+            auto iter = tmap.find(bdtree::null_key<std::string>::value());
+            for (auto& key : present) {
+                assert(iter != tmap.end() && iter->first == key && iter->second == key.size());
+                ++iter;
+            }
+            assert(iter == tmap.end());
+        };
+        check(keys);
+        // erasing runs of keys empties leaves, a leaf holding one long key is too large to be merged before
+        std::vector<std::string> present;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (i % 100 < 50) {
+                present.push_back(keys[i]);
+            } else {
+                auto erased = tmap.erase(keys[i]);
+                assert(erased);
+            }
+        }
+        check(present);
+        // inserting into an emptied leaf merges it first
+        auto emptied = leaves();
+        for (size_t i = 75; i < keys.size(); i += 100) {
+            auto inserted = tmap.insert(keys[i], keys[i].size());
+            assert(inserted);
+            present.push_back(keys[i]);
+        }
+        std::sort(present.begin(), present.end());
+        assert(leaves() < emptied);
+        check(present);
+    }
+
+    alloc.reset(new crossbow::allocator());
+    {
+        // test bit-packed signed keys
+        std::vector<int64_t> keys;
+        for (int64_t i = -20000; i < 20000; i += 7) {
+            keys.push_back(i * (i % 5 == 0 ? 1000 : 1));
+        }
+        std::shuffle(keys.begin(), keys.end(), std::mt19937(42));
+        dummy_backend pbackend;
+        bdtree::logical_table_cache<int64_t, uint64_t, dummy_backend> pcache;
+        bdtree::map<int64_t, uint64_t, dummy_backend> pmap(pbackend, pcache, bdtree::get_next_tx_id(), true);
+        for (auto key : keys) {
+            auto inserted = pmap.insert(key, uint64_t(key));
+            assert(inserted);
+        }
+        for (size_t i = 0; i < keys.size(); i += 2) {
+            auto erased = pmap.erase(keys[i]);
+            assert(erased);
+        }
+        std::vector<int64_t> remaining;
+        for (size_t i = 1; i < keys.size(); i += 2) {
+            remaining.push_back(keys[i]);
+        }
+        std::sort(remaining.begin(), remaining.end());
+        auto iter = pmap.find(bdtree::null_key<int64_t>::value());
+        for (auto key : remaining) {
+            assert(iter != pmap.end());
+            assert(iter->first == key && iter->second == uint64_t(key));
+            ++iter;
+        }
+        assert(iter == pmap.end());
+    }
+
+    alloc.reset(new crossbow::allocator());
+    {
+        // test leaves with separately stored values
+        dummy_backend vbackend;
+        bdtree::logical_table_cache<uint32_t, std::string, dummy_backend> vcache;
+        bdtree::map<uint32_t, std::string, dummy_backend> vmap(vbackend, vcache, bdtree::get_next_tx_id(), true);
+        for (uint32_t key = 1; key <= 3000; ++key) {
+            auto inserted = vmap.insert(key * 3, std::string(key % 64, 'v') + std::to_string(key));
+            assert(inserted);
+        }
+        bdtree::logical_table_cache<uint32_t, std::string, dummy_backend> rcache;
+        bdtree::map<uint32_t, std::string, dummy_backend> rmap(vbackend, rcache, bdtree::get_next_tx_id());
+        for (uint32_t key = 1; key <= 3000; ++key) {
+            assert(!rmap.insert(key * 3, std::string()));
+        }
+        auto iter = rmap.find(bdtree::null_key<uint32_t>::value());
+        for (uint32_t key = 1; key <= 3000; ++key) {
+            assert(iter != rmap.end());
+            assert(iter->first == key * 3 && iter->second == std::string(key % 64, 'v') + std::to_string(key));
+            ++iter;
+        }
+        assert(iter == rmap.end());
+    }
+
+    alloc.reset(new crossbow::allocator());
+    {
+        // test values stored out of line
+        typedef bdtree::separated_value<std::string> value_type;
+        dummy_backend sbackend;
+        bdtree::logical_table_cache<uint64_t, value_type, dummy_backend> scache;
+        bdtree::map<uint64_t, value_type, dummy_backend> smap(sbackend, scache, bdtree::get_next_tx_id(), true);
+        for (uint64_t key = 1; key <= 500; ++key) {
+            auto inserted = smap.insert(key, value_type(std::string(key % 2 ? 10 : 1000, char('a' + key % 26))));
+            assert(inserted);
+        }
+        std::vector<bdtree::physical_pointer> blobs;
+        auto iter = smap.find(1);
+        for (uint64_t key = 1; key <= 500; ++key, ++iter) {
+            assert(iter->first == key && iter->second.is_separated() == (key % 2 == 0));
+            assert(iter.value() == std::string(key % 2 ? 10 : 1000, char('a' + key % 26)));
+            if (iter->second.is_separated()) {
+                blobs.push_back(iter->second.reference());
+            }
+        }
+        assert(iter == smap.end());
+        {
+            // an iterator on the old leaf version still reads the value of an entry erased by another thread
+            bdtree::logical_table_cache<uint64_t, value_type, dummy_backend> hcache;
+            bdtree::map<uint64_t, value_type, dummy_backend> hmap(sbackend, hcache, bdtree::get_next_tx_id());
+            auto held = hmap.find(2);
+            std::thread eraser([&sbackend, &scache]() {
+                crossbow::allocator alloc;
+                bdtree::map<uint64_t, value_type, dummy_backend> emap(sbackend, scache, bdtree::get_next_tx_id());
+                auto erased = emap.erase(2);
+                assert(erased);
+            });
+            eraser.join();
+            assert(held->first == 2 && held.value() == std::string(1000, char('a' + 2)));
+        }
+        for (uint64_t key = 4; key <= 500; key += 2) {
+            auto erased = smap.erase(key);
+            assert(erased);
+        }
+        // the values are removed once no thread is inside an allocator scope anymore
+        alloc.reset();
+        for (auto pptr : blobs) {
+            std::error_code ec;
+            sbackend.get_node_table().read(pptr, ec);
+            assert(ec == bdtree::error::object_doesnt_exist);
+        }
+    }
+
+    alloc.reset(new crossbow::allocator());
+    {
+        // test negative lookups through the leaf filters: a key the filter rejects reads no node
+        typedef bdtree::latency_backend<dummy_backend> backend_t;
+        backend_t fbackend{bdtree::latency_backend_config()};
+        bdtree::logical_table_cache<uint64_t, uint64_t, backend_t> fcache;
+        bdtree::map<uint64_t, uint64_t, backend_t> fmap(fbackend, fcache, bdtree::next_tx_id(fbackend), true);
+        for (uint64_t key = 2; key <= 20000; key += 2) {
+            fmap.insert(key, key);
+        }
+        for (uint64_t key = 1; key <= 20001; ++key) {
+            assert(fmap.contains(key) == (key % 2 == 0));
+        }
+        // the first pass built the filters, with the leaves dropped from the cache only the absent keys a filter
+        // lets through read their leaf
+        std::vector<bdtree::logical_pointer> leaves;
+        {
+            bdtree::operation_context<uint64_t, uint64_t, backend_t> context{fbackend, fcache,
+                    bdtree::next_tx_id(fbackend)};
+            for (uint64_t lptr = 1; lptr <= fbackend.get_ptr_table().get_remote_ptr().value; ++lptr) {
+                auto np = context.get_from_cache(bdtree::logical_pointer{lptr});
+                if (np && np->node_->get_node_type() == bdtree::node_type_t::LeafNode) {
+                    leaves.push_back(np->lptr_);
+                }
+            }
+        }
+        auto leaf_reads = [&](uint64_t key) {
+            for (auto lptr : leaves) {
+                fcache.invalidate(lptr);
+            }
+            auto reads = fbackend.statistics(bdtree::backend_call::node_read).calls;
+            assert(fmap.contains(key) == (key % 2 == 0));
+            return fbackend.statistics(bdtree::backend_call::node_read).calls - reads;
+        };
+        assert(leaf_reads(2) == 1 && leaf_reads(20000) == 1);
+        uint64_t passed = 0;
+        for (uint64_t key = 1; key <= 20001; key += 2) {
+            passed += leaf_reads(key);
+        }
+        // about 1% false positives
+        assert(passed < 10001 / 20);
+        fmap.insert(1001, 1001);
+        fmap.erase(1000);
+        assert(fmap.contains(1001) && !fmap.contains(1000));
+    }
+
+    alloc.reset(new crossbow::allocator());
+    {
+        // test lookups through the learned index, before and after the tree changed
+        dummy_backend lbackend;
+        bdtree::logical_table_cache<uint64_t, uint64_t, dummy_backend> lcache;
+        bdtree::map<uint64_t, uint64_t, dummy_backend> lmap(lbackend, lcache, bdtree::get_next_tx_id(), true);
+        for (uint64_t key = 10; key <= 100000; key += 10) {
+            lmap.insert(key, key);
+        }
+        auto built = lmap.build_learned_index();
+        assert(built && lcache.learned_index()->segments() < lcache.learned_index()->size());
+        for (uint64_t key = 5; key <= 50005; key += 5) {
+            auto iter = lmap.find(key);
+            assert(iter != lmap.end() && iter->first == (key + 9) / 10 * 10);
+        }
+        for (uint64_t key = 100001; key <= 120000; ++key) {
+            lmap.insert(key, key);
+        }
+        auto iter = lmap.find(99995);
+        for (uint64_t key = 100000; key <= 120000; ++key, ++iter) {
+            assert(iter != lmap.end() && iter->first == key);
+        }
+        assert(iter == lmap.end());
+        // predictions far outside of a segment are clamped to it
+        bdtree::learned_leaf_index<double>::entries_type dentries;
+        for (uint64_t i = 1; i <= 1000; ++i) {
+            dentries.emplace_back(double(i * i), bdtree::logical_pointer{i});
+        }
+        bdtree::learned_leaf_index<double> dindex(std::move(dentries));
+        assert(dindex.find(std::numeric_limits<double>::max()).value == 1000);
+        assert(dindex.find(std::numeric_limits<double>::infinity()).value == 1000);
+        assert(dindex.find(-std::numeric_limits<double>::infinity()).value == 0);
+        assert(lcache.learned_index()->find(std::numeric_limits<uint64_t>::max()).value != 0);
+    }
+
+    alloc.reset(new crossbow::allocator());
+    {
+        // test appends and clustered lookups through a finger
+        dummy_backend gbackend;
+        bdtree::logical_table_cache<uint64_t, uint64_t, dummy_backend> gcache;
+        bdtree::map<uint64_t, uint64_t, dummy_backend> gmap(gbackend, gcache, bdtree::get_next_tx_id(), true);
+        gmap.set_finger(true);
+        for (uint64_t key = 1; key <= 30000; ++key) {
+            auto inserted = gmap.insert(key * 2, key);
+            assert(inserted);
+        }
+        for (uint64_t key = 29000; key > 7; key -= 7) {
+            assert(gmap.erase(key * 2));
+            auto iter = gmap.find(key * 2 - 1);
+            assert(iter != gmap.end() && iter->first == key * 2 + 2);
+        }
+        for (uint64_t key = 1; key <= 30000; key += 3) {
+            auto iter = gmap.find(key * 2);
+            assert(iter->first == ((29000 - key) % 7 == 0 && key > 7 && key <= 29000 ? key * 2 + 2 : key * 2));
+        }
+        // copies of a handle with a finger start with an empty one of their own
+        auto copy = gmap;
+        bdtree::map<uint64_t, uint64_t, dummy_backend> assigned(gbackend, gcache, bdtree::get_next_tx_id());
+        assigned = copy;
+        assert(copy.find(60000)->first == 60000 && assigned.find(2)->first == 2);
+        assert(gmap.find(4)->first == 4);
+    }
+
+    alloc.reset(new crossbow::allocator());
+    {
+        // test that appends fill the nodes better than inserts at the left edge
+        dummy_backend abackend;
+        bdtree::logical_table_cache<uint64_t, uint64_t, dummy_backend> acache;
+        bdtree::map<uint64_t, uint64_t, dummy_backend> amap(abackend, acache, bdtree::get_next_tx_id(), true);
+        dummy_backend dbackend;
+        bdtree::logical_table_cache<uint64_t, uint64_t, dummy_backend> dcache;
+        bdtree::map<uint64_t, uint64_t, dummy_backend> dmap(dbackend, dcache, bdtree::get_next_tx_id(), true);
+        for (uint64_t key = 1; key <= 50000; ++key) {
+            amap.insert(key, key);
+            dmap.insert(50001 - key, key);
+        }
+        for (uint64_t key = 1; key <= 50000; key += 7) {
+            assert(amap.find(key)->first == key);
+            assert(dmap.find(key)->first == key);
+        }
+        auto appended = abackend.get_ptr_table().get_remote_ptr().value;
+        auto prepended = dbackend.get_ptr_table().get_remote_ptr().value;
+        assert(appended * 5 < prepended * 4);
+    }
+
+    {
+        // test the lock-free pointer table, including concurrent updates of the same pointers
+        bdtree::basic_memory_ptr_table<64, 4> ptrs;
+        std::error_code ec;
+        for (uint64_t i = 1; i <= 200; ++i) {
+            assert(ptrs.get_next_ptr().value == i);
+            assert(ptrs.insert(bdtree::logical_pointer{i}, bdtree::physical_pointer{i}) == 1);
+        }
+        ptrs.insert(bdtree::logical_pointer{7}, bdtree::physical_pointer{1}, ec);
+        assert(ec == bdtree::error::object_exists);
+        ec = std::error_code();
+        ptrs.read(bdtree::logical_pointer{255}, ec);
+        assert(ec == bdtree::error::object_doesnt_exist);
+        ec = std::error_code();
+        ptrs.read(bdtree::logical_pointer{1000}, ec);
+        assert(ec == bdtree::error::object_doesnt_exist);
+        std::vector<std::thread> threads;
+        std::atomic_size_t updates(0);
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&ptrs, &updates]() {
+                for (int round = 0; round < 1000; ++round) {
+                    for (uint64_t i = 1; i <= 200; i += 13) {
+                        std::error_code ec;
+                        auto current = ptrs.read(bdtree::logical_pointer{i});
+                        ptrs.update(bdtree::logical_pointer{i}, bdtree::physical_pointer{std::get<0>(current).value + 1},
+                                std::get<1>(current), ec);
+                        if (!ec) {
+                            ++updates;
+                        } else {
+                            assert(ec == bdtree::error::wrong_version);
+                        }
+                    }
+                }
+            });
+        }
+        for (auto& thr : threads) {
+            thr.join();
+        }
+        size_t versions = 0;
+        for (uint64_t i = 1; i <= 200; i += 13) {
+            auto current = ptrs.read(bdtree::logical_pointer{i});
+            assert(std::get<0>(current).value == i + std::get<1>(current) - 1);
+            versions += std::get<1>(current) - 1;
+        }
+        assert(versions == updates);
+        ptrs.remove(bdtree::logical_pointer{7}, 0, ec);
+        assert(ec == bdtree::error::wrong_version);
+        ptrs.remove(bdtree::logical_pointer{7}, std::numeric_limits<uint64_t>::max());
+        ec = std::error_code();
+        ptrs.update(bdtree::logical_pointer{7}, bdtree::physical_pointer{1}, 1, ec);
+        assert(ec == bdtree::error::object_doesnt_exist);
+    }
+
+    {
+        // test the in-memory backend
+        bdtree::memory_node_table nodes;
+        auto pptr = nodes.get_next_ptr();
+        nodes.insert(pptr, "abc", 3);
+        auto data = nodes.read(pptr);
+        assert(data.length() == 3 && std::string(data.data(), data.length()) == "abc");
+        std::error_code ec;
+        nodes.insert(pptr, "x", 1, ec);
+        assert(ec == bdtree::error::object_exists);
+        ec = std::error_code();
+        nodes.read(bdtree::physical_pointer{pptr.value + (uint64_t(1) << 40)}, ec);
+        assert(ec == bdtree::error::object_doesnt_exist);
+        std::string large(100000, 'l');
+        auto large_pptr = nodes.get_next_ptr();
+        nodes.insert(large_pptr, large.data(), large.size());
+        assert(std::string(nodes.read(large_pptr).data(), large.size()) == large);
+        nodes.remove(pptr);
+        ec = std::error_code();
+        nodes.read(pptr, ec);
+        assert(ec == bdtree::error::object_doesnt_exist);
+        // removed slots come back with the next reuse count, a slot whose count is exhausted never comes back
+        bdtree::physical_pointer exhausted{nodes.get_next_ptr().value | (((uint64_t(1) << 24) - 1) << 40)};
+        nodes.insert(exhausted, "e", 1);
+        nodes.remove(exhausted);
+        alloc.reset();
+        alloc.reset(new crossbow::allocator());
+        assert(nodes.get_next_ptr().value == pptr.value + (uint64_t(1) << 40));
+        auto fresh = nodes.get_next_ptr();
+        assert((fresh.value & ((uint64_t(1) << 40) - 1)) != (exhausted.value & ((uint64_t(1) << 40) - 1)));
+
+        bdtree::memory_backend mbackend;
+        bdtree::logical_table_cache<uint64_t, uint64_t, bdtree::memory_backend> mcache;
+        bdtree::map<uint64_t, uint64_t, bdtree::memory_backend> mmap(mbackend, mcache, bdtree::next_tx_id(mbackend), true);
+        for (uint64_t key = 1; key <= 20000; ++key) {
+            auto inserted = mmap.insert(key * 7 % 20011, key);
+            assert(inserted);
+        }
+        for (uint64_t key = 1; key <= 20000; key += 2) {
+            assert(mmap.erase(key * 7 % 20011));
+        }
+        for (uint64_t key = 1; key <= 20000; ++key) {
+            auto iter = mmap.find(key * 7 % 20011);
+            assert((iter != mmap.end() && iter->first == key * 7 % 20011) == (key % 2 == 0));
+        }
+    }
+
+    {
+        // test leased pointers: consecutive within a thread, disjoint between threads and tables
+        std::unique_ptr<dummy_backend> lbackend(new dummy_backend());
+        auto first = lbackend->get_node_table().next_ptr();
+        assert(lbackend->get_node_table().next_ptr().value == first.value + 1);
+        assert(lbackend->get_node_table().get_remote_ptr().value == first.value + bdtree::PTR_LEASE_SIZE - 1);
+        assert(lbackend->get_ptr_table().next_ptr().value == 1);
+        lbackend.reset(new dummy_backend());
+        assert(lbackend->get_node_table().next_ptr().value == 1);
+        std::vector<std::vector<uint64_t>> leased(4);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&lbackend, &leased, t]() {
+                for (int i = 0; i < 1000; ++i) {
+                    leased[t].push_back(lbackend->get_node_table().next_ptr().value);
+                }
+            });
+        }
+        for (auto& thr : threads) {
+            thr.join();
+        }
+        std::vector<uint64_t> all;
+        for (auto& l : leased) {
+            all.insert(all.end(), l.begin(), l.end());
+        }
+        std::sort(all.begin(), all.end());
+        assert(std::adjacent_find(all.begin(), all.end()) == all.end() && all.front() > 1);
+        // a thread using many tables keeps its lease on every one of them
+        std::vector<std::unique_ptr<dummy_backend>> backends;
+        std::vector<uint64_t> firsts;
+        for (int i = 0; i < 16; ++i) {
+            backends.emplace_back(new dummy_backend());
+            firsts.push_back(backends.back()->get_node_table().next_ptr().value);
+        }
+        for (size_t i = 0; i < backends.size(); ++i) {
+            assert(backends[i]->get_node_table().next_ptr().value == firsts[i] + 1);
+        }
+    }
+
+    {
+        // test the tx id sources: a new id is above every earlier last id
+        bdtree::clock_tx_id_source clock;
+        auto before = clock.last();
+        auto id = clock.next();
+        assert(id > before);
+        clock.observe(id + 1000000000000ull);
+        assert(clock.next() > id + 1000000000000ull && clock.last() >= id + 1000000000000ull);
+        dummy_backend tbackend;
+        auto last = bdtree::get_last_tx_id();
+        assert(bdtree::next_tx_id(tbackend) > last);
+        assert(&bdtree::tx_id_source(tbackend) == &bdtree::default_tx_id_source());
+        // the clock source is opt-in, handles created without an id draw it from the backend's source
+        bdtree::memory_backend gbackend;
+        assert(&bdtree::tx_id_source(gbackend) == &bdtree::default_tx_id_source());
+        typedef bdtree::basic_memory_backend<bdtree::clock_tx_id_source> clock_backend;
+        clock_backend cbackend;
+        assert(&bdtree::tx_id_source(cbackend) == &cbackend.get_tx_id_source());
+        bdtree::logical_table_cache<uint64_t, uint64_t, clock_backend> ccache;
+        bdtree::map<uint64_t, uint64_t, clock_backend> cmap(cbackend, ccache, bdtree::next_tx_id(cbackend), true);
+        for (uint64_t key = 1; key <= 1000; ++key) {
+            cmap.insert(key, key);
+        }
+        bdtree::map<uint64_t, uint64_t, clock_backend> reader(cbackend, ccache);
+        cmap.erase(500);
+        bdtree::map<uint64_t, uint64_t, clock_backend> later(cbackend, ccache);
+        assert(later.find(500)->first == 501 && later.find(499)->first == 499);
+        assert(reader.find(1000)->second == 1000);
+    }
+
+    {
+        // test the file backend: a tree written by one instance is found by the next, a torn record is cut off
+        char dir_template[] = "/tmp/bdtree-test-XXXXXX";
+        std::string dir = mkdtemp(dir_template);
+        bdtree::file_backend_config config;
+        config.sync = false;
+        config.checkpoint_interval = 1000;
+        {
+            bdtree::file_backend fbackend(dir, config);
+            assert(fbackend.empty());
+            bdtree::logical_table_cache<uint64_t, uint64_t, bdtree::file_backend> fcache;
+            bdtree::map<uint64_t, uint64_t, bdtree::file_backend> fmap(fbackend, fcache, bdtree::next_tx_id(fbackend),
+                    true);
+            for (uint64_t key = 1; key <= 5000; ++key) {
+                auto inserted = fmap.insert(key * 7 % 5003, key);
+                assert(inserted);
+            }
+            for (uint64_t key = 1; key <= 5000; key += 2) {
+                assert(fmap.erase(key * 7 % 5003));
+            }
+            // a duplicate insert fails without writing to the log
+            struct stat before, after;
+            stat((dir + "/nodes.log").c_str(), &before);
+            std::error_code ec;
+            auto& nodes = fbackend.get_node_table();
+            auto pptr = nodes.get_remote_ptr();
+            for (; nodes.read(pptr, ec), ec; --pptr.value) {
+                ec = std::error_code();
+            }
+            nodes.insert(pptr, "duplicate", 9, ec);
+            assert(ec == bdtree::error::object_exists);
+            stat((dir + "/nodes.log").c_str(), &after);
+            assert(before.st_size == after.st_size);
+        }
+        {
+            // a record header claiming more bytes than the file holds ends the replay like a torn record
+            std::ofstream log(dir + "/nodes.log", std::ios::app | std::ios::binary);
+            uint64_t pptr = 1;
+            uint32_t length_and_checksum[] = {0x7ffffff0u, 0};
+            log.write(reinterpret_cast<const char*>(&pptr), sizeof(pptr));
+            log.write(reinterpret_cast<const char*>(length_and_checksum), sizeof(length_and_checksum));
+            log << "torn";
+        }
+        for (int reopen = 0; reopen < 2; ++reopen) {
+            // the second instance goes through an io_uring, if the kernel has one
+            config.io_queue_depth = reopen == 1 ? 32 : 0;
+            config.io_registered_buffers = 4;
+            bdtree::file_backend fbackend(dir, config);
+            assert(!fbackend.empty());
+            bdtree::logical_table_cache<uint64_t, uint64_t, bdtree::file_backend> fcache;
+            bdtree::map<uint64_t, uint64_t, bdtree::file_backend> fmap(fbackend, fcache, bdtree::next_tx_id(fbackend));
+            for (uint64_t key = 1; key <= 5000; ++key) {
+                auto iter = fmap.find(key * 7 % 5003);
+                assert((iter != fmap.end() && iter->second == key) == (key % 2 == 0 || reopen == 1));
+                if (reopen == 0 && key % 2 == 1) {
+                    auto inserted = fmap.insert(key * 7 % 5003, key);
+                    assert(inserted);
+                }
+            }
+            auto stats = fbackend.get_io_engine().statistics();
+            assert(stats.requests > 0);
+            if (fbackend.get_io_engine().uses_io_uring()) {
+                assert(reopen == 1);
+                assert(stats.batches > 0 && stats.batches <= stats.requests);
+                assert(stats.max_queue_depth > 0 && stats.max_queue_depth <= 32);
+            }
+        }
+        auto d = opendir(dir.c_str());
+        while (auto entry = readdir(d)) {
+            if (entry->d_name[0] != '.') {
+                unlink((dir + "/" + entry->d_name).c_str());
+            }
+        }
+        closedir(d);
+        rmdir(dir.c_str());
+    }
+
+    {
+        // test tree images: everything written is found through the mapping, writes are refused
+        dummy_backend sbackend;
+        bdtree::logical_table_cache<uint64_t, uint64_t, dummy_backend> scache;
+        bdtree::map<uint64_t, uint64_t, dummy_backend> smap(sbackend, scache, bdtree::get_next_tx_id(), true);
+        for (uint64_t key = 1; key <= 20000; ++key) {
+            auto inserted = smap.insert(key * 7 % 20011, key);
+            assert(inserted);
+        }
+        char path_template[] = "/tmp/bdtree-image-XXXXXX";
+        close(mkstemp(path_template));
+        bdtree::write_image(sbackend, scache, path_template);
+        {
+            bdtree::image_backend ibackend(path_template);
+            bdtree::logical_table_cache<uint64_t, uint64_t, bdtree::image_backend> icache;
+            bdtree::map<uint64_t, uint64_t, bdtree::image_backend> imap(ibackend, icache, bdtree::next_tx_id(ibackend));
+            for (uint64_t key = 1; key <= 20000; ++key) {
+                auto iter = imap.find(key * 7 % 20011);
+                assert(iter != imap.end() && iter->second == key);
+            }
+            assert(imap.find(20011) == imap.end());
+            size_t count = 0;
+            for (auto iter = imap.find(0); iter != imap.end(); ++iter) {
+                ++count;
+            }
+            assert(count == 20000);
+            bool refused = false;
+            try {
+                imap.insert(20011, 1);
+            } catch (std::system_error& e) {
+                refused = e.code() == std::errc::read_only_file_system;
+            }
+            assert(refused);
+        }
+        unlink(path_template);
+
+        // values stored out of line are copied into the image
+        typedef bdtree::separated_value<std::string> value_type;
+        dummy_backend vbackend;
+        bdtree::logical_table_cache<uint64_t, value_type, dummy_backend> vcache;
+        bdtree::map<uint64_t, value_type, dummy_backend> vmap(vbackend, vcache, bdtree::get_next_tx_id(), true);
+        for (uint64_t key = 1; key <= 2000; ++key) {
+            auto inserted = vmap.insert(key, value_type(std::string(key % 3 ? 10 : 700, char('a' + key % 26))));
+            assert(inserted);
+        }
+        bdtree::write_image(vbackend, vcache, path_template);
+        {
+            bdtree::image_backend ibackend(path_template);
+            bdtree::logical_table_cache<uint64_t, value_type, bdtree::image_backend> icache;
+            bdtree::map<uint64_t, value_type, bdtree::image_backend> imap(ibackend, icache, bdtree::next_tx_id(ibackend));
+            uint64_t key = 1;
+            for (auto iter = imap.find(1); iter != imap.end(); ++iter, ++key) {
+                assert(iter->first == key && iter->second.is_separated() == (key % 3 == 0));
+                assert(iter.value() == std::string(key % 3 ? 10 : 700, char('a' + key % 26)));
+            }
+            assert(key == 2001);
+        }
+        unlink(path_template);
+    }
+
+    {
+        // test the latency backend: calls are delayed and counted, pointer leases save round-trips
+        bdtree::latency_backend_config config;
+        config[bdtree::backend_call::node_read] = bdtree::latency_distribution::constant(20000);
+        config[bdtree::backend_call::ptr_update] = bdtree::latency_distribution::uniform(1000, 5000);
+        config.bandwidth = uint64_t(1) << 30;
+        typedef bdtree::latency_backend<bdtree::memory_backend> backend_t;
+        backend_t lbackend(config);
+        bdtree::logical_table_cache<uint64_t, uint64_t, backend_t> lcache;
+        bdtree::map<uint64_t, uint64_t, backend_t> lmap(lbackend, lcache, bdtree::next_tx_id(lbackend), true);
+        for (uint64_t key = 1; key <= 2000; ++key) {
+            auto inserted = lmap.insert(key, key);
+            assert(inserted);
+        }
+        for (uint64_t key = 1; key <= 2000; ++key) {
+            auto iter = lmap.find(key);
+            assert(iter != lmap.end() && iter->second == key);
+        }
+        auto reads = lbackend.statistics(bdtree::backend_call::node_read);
+        assert(reads.calls > 0 && reads.bytes > 0 && reads.delay_ns >= reads.calls * 20000);
+        assert(reads.total_ns >= reads.delay_ns);
+        auto inserts = lbackend.statistics(bdtree::backend_call::node_insert);
+        assert(inserts.calls > 2000 && inserts.errors == 0);
+        auto leases = lbackend.statistics(bdtree::backend_call::ptr_next);
+        auto splits = lbackend.statistics(bdtree::backend_call::ptr_insert);
+        assert(leases.calls * bdtree::PTR_LEASE_SIZE >= splits.calls && leases.calls < splits.calls);
+        lbackend.reset_statistics();
+        assert(lbackend.statistics(bdtree::backend_call::node_read).calls == 0);
+        // a lookup through cached inner nodes reads the pointer of its leaf once
+        for (uint64_t key = 1; key <= 2000; ++key) {
+            assert(lmap.contains(key));
+        }
+        assert(lbackend.statistics(bdtree::backend_call::ptr_read).calls == 2000);
+    }
+
+    {
+        // test call traces: a recorded run replays against a fresh backend with the same outcome of every call
+        char path_template[] = "/tmp/bdtree-trace-XXXXXX";
+        close(mkstemp(path_template));
+        uint64_t recorded = 0;
+        {
+            typedef bdtree::trace_backend<bdtree::memory_backend> backend_t;
+            backend_t tbackend(path_template);
+            bdtree::logical_table_cache<uint64_t, uint64_t, backend_t> tcache;
+            bdtree::map<uint64_t, uint64_t, backend_t> tmap(tbackend, tcache, bdtree::next_tx_id(tbackend), true);
+            for (uint64_t key = 1; key <= 5000; ++key) {
+                auto inserted = tmap.insert(key * 7 % 5003, key);
+                assert(inserted);
+            }
+            for (uint64_t key = 1; key <= 5000; key += 2) {
+                auto erased = tmap.erase(key * 7 % 5003);
+                assert(erased);
+            }
+            recorded = tbackend.records();
+        }
+        auto records = bdtree::read_trace(path_template);
+        assert(recorded > 5000 && records.size() == recorded);
+        assert(std::is_sorted(records.begin(), records.end(),
+                [](const bdtree::trace_record& a, const bdtree::trace_record& b) { return a.start_ns < b.start_ns; }));
+        bdtree::memory_backend rbackend;
+        bdtree::trace_replay_options options;
+        options.speed = 0;
+        auto res = bdtree::replay_trace(rbackend, records, options);
+        uint64_t replayed = 0;
+        for (auto& stats : res.calls) {
+            replayed += stats.calls;
+            assert(stats.mismatches == 0);
+        }
+        assert(replayed == recorded && res[bdtree::backend_call::node_insert].calls > 5000);
+        {
+            // the records of every thread reach the file
+            typedef bdtree::trace_backend<bdtree::memory_backend> backend_t;
+            backend_t tbackend(path_template);
+            bdtree::logical_table_cache<uint64_t, uint64_t, backend_t> tcache;
+            bdtree::map<uint64_t, uint64_t, backend_t> tmap(tbackend, tcache, bdtree::next_tx_id(tbackend), true);
+            for (uint64_t key = 1; key <= 5000; ++key) {
+                tmap.insert(key, key);
+            }
+            std::thread reader([&]() {
+                bdtree::map<uint64_t, uint64_t, backend_t> rmap(tbackend, tcache);
+                for (uint64_t key = 1; key <= 5000; ++key) {
+                    assert(rmap.find(key)->second == key);
+                }
+            });
+            reader.join();
+            recorded = tbackend.records();
+        }
+        records = bdtree::read_trace(path_template);
+        assert(records.size() == recorded && records.front().thread != records.back().thread);
+        unlink(path_template);
+    }
+
+    {
+        // test interpolation search against binary search
+        std::vector<uint64_t> uniform, skewed, dense;
+        for (uint64_t i = 0; i < 200; ++i) {
+            uniform.push_back(i * 1000 + i % 7);
+            skewed.push_back(i * i * i * i * i);
+            if (i < 100) {
+                // consecutive nanosecond timestamps that all convert to the same double
+                dense.push_back((uint64_t(1) << 60) + i);
+            }
+        }
+        check_key_bounds(uniform);
+        check_key_bounds(skewed);
+        check_key_bounds(dense);
+        std::vector<int64_t> extremes{std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max()};
+        for (int64_t i = 1; i < 100; ++i) {
+            extremes.push_back(std::numeric_limits<int64_t>::min() + i);
+            extremes.push_back(std::numeric_limits<int64_t>::max() - i);
+            extremes.push_back(i * 37 - 1800);
+        }
+        check_key_bounds(extremes);
+        std::vector<int32_t> small{std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max()};
+        for (int32_t i = -50; i < 50; ++i) {
+            small.push_back(i);
+        }
+        check_key_bounds(small);
+    }
+
+    {
+        // test the leaf hash index on both sides of min_entries
+        for (auto size : {size_t(10), bdtree::leaf_index_traits<uint64_t>::min_entries, size_t(1000)}) {
+            bdtree::leaf_node<uint64_t, uint64_t> leaf(bdtree::physical_pointer{1});
+            for (uint64_t i = 0; i < size; ++i) {
+                leaf.array_.emplace_back(i * 2, i);
+            }
+            // the write path probes without building the index, finds build it; both match the std algorithms
+            bdtree::key_compare<uint64_t, uint64_t> cmp;
+            for (uint64_t i = 0; i < size * 2 + 10; ++i) {
+                assert(leaf.has_key(i, false) == std::binary_search(leaf.array_.begin(), leaf.array_.end(), i, cmp));
+            }
+            assert(leaf.hash_index(false) == nullptr);
+            for (uint64_t i = 0; i < size * 2 + 10; ++i) {
+                assert(bdtree::leaf_lower_bound(leaf, i, cmp)
+                        == std::lower_bound(leaf.array_.begin(), leaf.array_.end(), i, cmp));
+                assert(leaf.has_key(i) == (i % 2 == 0 && i < size * 2));
+                assert(leaf.has_key(i, false) == leaf.has_key(i));
+            }
+            assert((leaf.hash_index(false) != nullptr) == (size >= bdtree::leaf_index_traits<uint64_t>::min_entries));
+        }
+        bdtree::leaf_node<std::string, uint64_t> sleaf(bdtree::physical_pointer{1});
+        for (int i = 0; i < 500; ++i) {
+            sleaf.array_.emplace_back("key" + std::to_string(1000 + i * 2), i);
+        }
+        for (int i = 0; i < 1000; ++i) {
+            assert(sleaf.has_key("key" + std::to_string(1000 + i)) == (i % 2 == 0));
+        }
+        assert(!sleaf.has_key(""));
+        assert(!sleaf.has_key("key"));
+        assert(!sleaf.has_key("key10000"));
+        std::vector<std::pair<colliding_key, uint64_t>> colliding;
+        for (uint64_t i = 0; i < 200; ++i) {
+            colliding.emplace_back(colliding_key{i * 3}, i);
+        }
+        bdtree::leaf_hash_index<colliding_key> index(colliding);
+        for (uint64_t i = 0; i < 700; ++i) {
+            assert(index.contains(colliding, colliding_key{i}) == (i % 3 == 0 && i < 600));
+        }
+    }
+
+    {
+        // test the node stack beyond its inline capacity
+        bdtree::basic_pointer_stack<4> stack;
+        for (uint64_t i = 1; i <= 10; ++i) {
+            stack.push(bdtree::logical_pointer{i});
+        }
+        auto copy = stack;
+        assert(copy == stack && copy.size() == 10);
+        for (uint64_t i = 10; i >= 1; --i) {
+            assert(stack.top().value == i);
+            stack.pop();
+        }
+        assert(stack.empty() && copy != stack);
+    }
+
     alloc.reset(new crossbow::allocator());
     bdtree::logical_table_cache<uint64_t, uint64_t, dummy_backend> cache;
     bdtree::map<uint64_t, uint64_t, dummy_backend> map(backend, cache, bdtree::get_next_tx_id());